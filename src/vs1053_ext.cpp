@@ -59,82 +59,121 @@ uint16_t AudioBuffer::getMaxBlockSize(){
 }
 
 size_t AudioBuffer::freeSpace() {
-    if(m_readPtr >= m_writePtr) {
-        m_freeSpace = (m_readPtr - m_writePtr);
-    } else {
-        m_freeSpace = (m_endPtr - m_writePtr) + (m_readPtr - m_buffer);
+    uint8_t* rp = m_readPtr.load(std::memory_order_acquire);
+    uint8_t* wp = m_writePtr.load(std::memory_order_acquire);
+    if(rp > wp) {
+        return (rp - wp) - 1;
     }
-    if(m_f_start)
-        m_freeSpace = m_buffSize;
-    return m_freeSpace - 1;
+    return (m_endPtr - wp) + (rp - m_buffer) - 1;
 }
 
 size_t AudioBuffer::writeSpace() {
-    if(m_readPtr >= m_writePtr) {
-        m_writeSpace = (m_readPtr - m_writePtr - 1); // readPtr must not be overtaken
-    } else {
-        if(getReadPos() == 0)
-            m_writeSpace = (m_endPtr - m_writePtr - 1);
-        else
-            m_writeSpace = (m_endPtr - m_writePtr);
+    uint8_t* rp = m_readPtr.load(std::memory_order_acquire);
+    uint8_t* wp = m_writePtr.load(std::memory_order_relaxed);
+    if(rp > wp) {
+        return (rp - wp) - 1; // readPtr must not be overtaken
     }
-    if(m_f_start)
-        m_writeSpace = m_buffSize - 1;
-    return m_writeSpace;
+    if(rp == m_buffer) {
+        return (m_endPtr - wp) - 1; // writePtr must not wrap onto readPtr
+    }
+    return (m_endPtr - wp);
 }
 
 size_t AudioBuffer::bufferFilled() {
-    if(m_writePtr >= m_readPtr) {
-        m_dataLength = (m_writePtr - m_readPtr);
-    } else {
-        m_dataLength = (m_endPtr - m_readPtr) + (m_writePtr - m_buffer);
+    uint8_t* wp = m_writePtr.load(std::memory_order_acquire);
+    uint8_t* rp = m_readPtr.load(std::memory_order_acquire);
+    if(wp >= rp) {
+        return (wp - rp);
     }
-    return m_dataLength;
+    return (m_endPtr - rp) + (wp - m_buffer);
 }
 
 void AudioBuffer::bytesWritten(size_t bw) {
-    m_writePtr += bw;
-    if(m_writePtr == m_endPtr) {
-        m_writePtr = m_buffer;
+    uint8_t* wp = m_writePtr.load(std::memory_order_relaxed) + bw;
+    if(wp >= m_endPtr) {
+        wp = m_buffer + (wp - m_endPtr);
     }
-    if(bw && m_f_start)
-        m_f_start = false;
+    m_writePtr.store(wp, std::memory_order_release); // publish the data written before
 }
 
 void AudioBuffer::bytesWasRead(size_t br) {
-    m_readPtr += br;
-    if(m_readPtr >= m_endPtr) {
-        size_t tmp = m_readPtr - m_endPtr;
-        m_readPtr = m_buffer + tmp;
+    uint8_t* rp = m_readPtr.load(std::memory_order_relaxed) + br;
+    if(rp >= m_endPtr) {
+        rp = m_buffer + (rp - m_endPtr);
     }
+    m_readPtr.store(rp, std::memory_order_release); // give the space free for the producer
 }
 
 uint8_t* AudioBuffer::getWritePtr() {
-    return m_writePtr;
+    return m_writePtr.load(std::memory_order_relaxed);
+}
+
+AudioBuffer::span_t AudioBuffer::reserve(size_t len) {
+    span_t sp = {NULL, 0, NULL, 0};
+    uint8_t* wp = m_writePtr.load(std::memory_order_relaxed);
+    uint8_t* rp = m_readPtr.load(std::memory_order_acquire);
+    sp.ptr1 = wp;
+    if(rp > wp) {
+        sp.len1 = min((size_t)(rp - wp - 1), len);
+        return sp;
+    }
+    if(rp == m_buffer) {
+        sp.len1 = min((size_t)(m_endPtr - wp - 1), len);
+        return sp;
+    }
+    sp.len1 = min((size_t)(m_endPtr - wp), len);
+    len -= sp.len1;
+    if(len) {
+        sp.ptr2 = m_buffer;
+        sp.len2 = min((size_t)(rp - m_buffer - 1), len);
+    }
+    return sp;
+}
+
+void AudioBuffer::commit(size_t len) {
+    bytesWritten(len);
 }
 
 uint8_t* AudioBuffer::getReadPtr() {
-    size_t len = m_endPtr - m_readPtr;
+    uint8_t* rp = m_readPtr.load(std::memory_order_relaxed);
+    size_t len = m_endPtr - rp;
     if(len < m_maxBlockSize) { // be sure the last frame is completed
         memcpy(m_endPtr, m_buffer, m_maxBlockSize - len);  // cpy from m_buffer to m_endPtr with len
     }
-return m_readPtr;
+    return rp;
+}
+
+AudioBuffer::span_t AudioBuffer::getReadSpan(size_t maxLen) {
+    span_t sp = {NULL, 0, NULL, 0};
+    uint8_t* rp = m_readPtr.load(std::memory_order_relaxed);
+    uint8_t* wp = m_writePtr.load(std::memory_order_acquire);
+    sp.ptr1 = rp;
+    if(wp >= rp) {
+        sp.len1 = min((size_t)(wp - rp), maxLen);
+        return sp;
+    }
+    sp.len1 = min((size_t)(m_endPtr - rp), maxLen);
+    maxLen -= sp.len1;
+    if(maxLen) {
+        sp.ptr2 = m_buffer;
+        sp.len2 = min((size_t)(wp - m_buffer), maxLen);
+    }
+    return sp;
 }
 
 void AudioBuffer::resetBuffer() {
-    m_writePtr = m_buffer;
-    m_readPtr = m_buffer;
     m_endPtr = m_buffer + m_buffSize;
-    m_f_start = true;
+    m_writePtr.store(m_buffer, std::memory_order_relaxed);
+    m_readPtr.store(m_buffer, std::memory_order_release);
     // memset(m_buffer, 0, m_buffSize); //Clear Inputbuffer
 }
 
 uint32_t AudioBuffer::getWritePos() {
-    return m_writePtr - m_buffer;
+    return m_writePtr.load(std::memory_order_relaxed) - m_buffer;
 }
 
 uint32_t AudioBuffer::getReadPos() {
-    return m_readPtr - m_buffer;
+    return m_readPtr.load(std::memory_order_relaxed) - m_buffer;
 }
 //---------------------------------------------------------------------------------------------------------------------
 // **** VS1053 Impl ****
@@ -168,20 +207,34 @@ VS1053::VS1053(uint8_t _cs_pin, uint8_t _dcs_pin, uint8_t _dreq_pin, uint8_t spi
 
 
     clientsecure.setInsecure();                 // update to ESP32 Arduino version 1.0.5-rc05 or higher
+    m_mutex = xSemaphoreCreateRecursiveMutex();
+    m_fileMutex = xSemaphoreCreateRecursiveMutex();
     m_endFillByte=0;
     m_vol = 20;
     m_LFcount=0;
 }
 VS1053::~VS1053(){
     // destructor
+    stopTask();
+    stopReaderTask();
+    cancelPendingConnection();
+    clearConnPool();
+    if(m_heapClient) {m_heapClient->stop(); delete m_heapClient; m_heapClient = NULL;}
+    if(m_connHost)   {free(m_connHost);    m_connHost    = NULL;}
+    vector_clear_and_shrink(m_playQueue);
+    vector_clear_and_shrink(m_abr.url);
+    if(m_pwsHLS.ID3Buff) {free(m_pwsHLS.ID3Buff); m_pwsHLS.ID3Buff = NULL;}
     if(m_chbuf)      {free(m_chbuf);       m_chbuf       = NULL;}
     if(m_lastHost)   {free(m_lastHost);    m_lastHost    = NULL;}
     if(m_ibuff)      {free(m_ibuff);       m_ibuff       = NULL;}
     if(m_lastM3U8host){free(m_lastM3U8host); m_lastM3U8host = NULL;}
+    if(m_dreqSem)    {detachInterrupt(dreq_pin); vSemaphoreDelete(m_dreqSem); m_dreqSem = NULL;}
+    if(m_mutex)      {vSemaphoreDelete(m_mutex); m_mutex = NULL;}
+    if(m_fileMutex)  {vSemaphoreDelete(m_fileMutex); m_fileMutex = NULL;}
 }
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::initInBuff() {
-    static bool f_already_done = false;
+    bool& f_already_done = m_f_inBuffInit;
     if(!f_already_done) {
         size_t size = InBuff.init();
         if(size == m_buffSizeRAM - m_resBuffSizeRAM) {
@@ -222,6 +275,28 @@ void VS1053::data_mode_off()
     spi_VS1053->endTransaction();                       // Allow other SPI users
 }
 //---------------------------------------------------------------------------------------------------------------------
+void IRAM_ATTR VS1053::dreqISR(void* arg){
+    VS1053* vs = (VS1053*)arg;
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    xSemaphoreGiveFromISR(vs->m_dreqSem, &xHigherPriorityTaskWoken);
+    if(xHigherPriorityTaskWoken) portYIELD_FROM_ISR();
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::await_data_request(){
+    // DREQ is low for a few µs after an SCI operation, but up to some ms while the 2048 byte SDI FIFO is full.
+    // The short waits are spun off, for the long ones the task blocks until the rising edge, the interrupt
+    // is only enabled during that time.
+    for(uint8_t i = 0; i < 64; i++) {if(DREQ()) return;}
+    if(!m_dreqSem) {while(!DREQ()) NOP(); return;}          // begin() not called yet
+    xSemaphoreTake(m_dreqSem, 0);                           // drop an old edge
+    gpio_intr_enable((gpio_num_t)dreq_pin);
+    // an edge before the enable is not lost, DREQ() is read after it
+    if(!DREQ() && xSemaphoreTake(m_dreqSem, pdMS_TO_TICKS(DREQ_TIMEOUT_MS)) != pdTRUE) {
+        if(!DREQ()) log_w("DREQ is low for more than %u ms", DREQ_TIMEOUT_MS);
+    }
+    gpio_intr_disable((gpio_num_t)dreq_pin);
+}
+//---------------------------------------------------------------------------------------------------------------------
 uint16_t VS1053::read_register(uint8_t _reg)
 {
     uint16_t result=0;
@@ -245,13 +320,29 @@ void VS1053::write_register(uint8_t _reg, uint16_t _value)
     control_mode_off();
 }
 //---------------------------------------------------------------------------------------------------------------------
+void VS1053::write_register_run(uint8_t _reg, const uint16_t* values, uint16_t n, bool repeat)
+{
+    // SCI multiple write: xCS stays low, opcode and register are sent once and every following word goes to the
+    // same register (SCI_WRAM increments the address itself). DREQ has to be high before each word.
+    if(!n) return;
+    control_mode_on();
+    spi_VS1053->write(2);                                           // Write operation
+    spi_VS1053->write(_reg);                                        // Register to write (0..0xF)
+    while(n--){
+        spi_VS1053->write16(*values);                               // Send 16 bits data
+        if(!repeat) values++;
+        await_data_request();
+    }
+    control_mode_off();
+}
+//---------------------------------------------------------------------------------------------------------------------
 size_t VS1053::sendBytes(uint8_t* data, size_t len){
     size_t chunk_length = 0;                                // Length of chunk 32 byte or shorter
     size_t bytesDecoded = 0;
 
     data_mode_on();
     while(len){                                             // More to do?
-        if(!digitalRead(dreq_pin)) break;
+        if(!DREQ()) break;
         chunk_length = len;
         if(len > vs1053_chunk_size){
             chunk_length = vs1053_chunk_size;
@@ -265,6 +356,68 @@ size_t VS1053::sendBytes(uint8_t* data, size_t len){
     return bytesDecoded;
 }
 //---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::sendSpan(size_t maxLen){
+    // sends up to maxLen bytes from InBuff, the wraparound is sent as a second segment instead of being copied
+    if(m_m4a.f_demux) return m4aSendSpan(maxLen);
+    AudioBuffer::span_t sp = InBuff.getReadSpan(maxLen);
+    size_t bytesDecoded = sendBytes(sp.ptr1, sp.len1);
+    if(bytesDecoded == sp.len1 && sp.len2) bytesDecoded += sendBytes(sp.ptr2, sp.len2);
+    if(bytesDecoded) InBuff.bytesWasRead(bytesDecoded);
+    return bytesDecoded;
+}
+//---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::readToInBuff(size_t len){
+    // reads up to len bytes from the client directly into InBuff, across the wraparound if necessary
+    AudioBuffer::span_t sp = InBuff.reserve(len);
+    size_t bytesRead = 0;
+    if(sp.len1) bytesRead = streamRead(sp.ptr1, sp.len1);
+    if(bytesRead == sp.len1 && sp.len2) bytesRead += streamRead(sp.ptr2, sp.len2);
+    if(bytesRead) InBuff.commit(bytesRead);
+    return bytesRead;
+}
+//---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::writeToInBuff(const uint8_t* data, size_t len){
+    AudioBuffer::span_t sp = InBuff.reserve(len);
+    memcpy(sp.ptr1, data, sp.len1);
+    if(sp.len2) memcpy(sp.ptr2, data + sp.len1, sp.len2);
+    InBuff.commit(sp.len1 + sp.len2);
+    if(sp.len1 + sp.len2 < len) log_e("InBuff overflow, %u bytes lost", len - (sp.len1 + sp.len2));
+    return sp.len1 + sp.len2;
+}
+//---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::demuxToInBuff(size_t len){
+    // webstream: reads up to len bytes straight into InBuff and takes the ICY metadata blocks out in the same pass,
+    // only the audio behind a block is moved down. After a reconnect the audio starts at the first frame header.
+    // Only the first segment of the span is used, the part after the wraparound follows with the next call.
+    AudioBuffer::span_t sp = InBuff.reserve(len);
+    if(!sp.len1) return 0;
+    size_t n = streamRead(sp.ptr1, sp.len1);
+    uint8_t* rd  = sp.ptr1;
+    uint8_t* wr  = sp.ptr1;
+    uint8_t* end = sp.ptr1 + n;
+    while(rd < end){
+        if(m_f_metadata && !m_metacount) {rd += readMetadata(rd, end - rd); continue;}
+        size_t run = end - rd;                                  // audio up to the next metadata block
+        if(m_f_metadata) run = min(run, (size_t)m_metacount);
+        size_t skip = 0;
+        if(m_f_resync) {                                        // reconnected, splice at a frame header
+            int idx = findFrameSync(rd, run);
+            skip = (idx < 0) ? run : idx;
+            m_resyncSkipped += skip;
+            if(idx >= 0 || m_resyncSkipped >= 65536) {          // found, or give up and let the decoder find it
+                AUDIO_INFO("stream resumed, %lu bytes skipped up to the frame header", (long unsigned)m_resyncSkipped);
+                m_f_resync = false;
+            }
+        }
+        if(run > skip && wr != rd + skip) memmove(wr, rd + skip, run - skip);
+        wr += run - skip;
+        rd += run;
+        if(m_f_metadata) m_metacount -= run;
+    }
+    if(wr != sp.ptr1) InBuff.commit(wr - sp.ptr1);
+    return wr - sp.ptr1;
+}
+//---------------------------------------------------------------------------------------------------------------------
 void VS1053::sdi_send_buffer(uint8_t* data, size_t len)
 {
     size_t chunk_length;                                    // Length of chunk 32 byte or shorter
@@ -316,7 +469,13 @@ uint16_t VS1053::wram_read(uint16_t address){
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::begin(){
 
+    lock_t lck(m_mutex);
     pinMode(dreq_pin, INPUT_PULLUP);                        // DREQ is an input
+    if(!m_dreqSem) {
+        m_dreqSem = xSemaphoreCreateBinary();
+        attachInterruptArg(dreq_pin, dreqISR, this, RISING);
+        gpio_intr_disable((gpio_num_t)dreq_pin);            // armed by await_data_request() only
+    }
     pinMode(cs_pin, OUTPUT);                                // The SCI and SDI signals
     pinMode(dcs_pin, OUTPUT);
     DCS_HIGH();
@@ -358,6 +517,7 @@ void VS1053::begin(){
 //---------------------------------------------------------------------------------------------------------------------
 uint16_t VS1053::getVUlevel() {
     if(!m_f_VUmeter) return 0;
+    lock_t lck(m_mutex);                        // SCI access, the loop task may be sending data
     uint16_t vum = read_register(SCI_AICTRL3);  // returns the values in 1 dB resolution from 0 (lowest) 95 (highest)
     uint8_t right = vum >> 8;                   // MSB left channel
     uint8_t left  = vum & 0x00FF;               // LSB left channel
@@ -375,6 +535,7 @@ size_t VS1053::bufferFree(){
 }
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::setVolumeSteps(uint8_t steps) {
+    lock_t lck(m_mutex);
     if(!steps) steps = 1;  // 0 is nonsense
     m_vol_steps = steps;
 }
@@ -384,6 +545,7 @@ uint8_t VS1053::maxVolume() {
 };
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::setVolume(uint8_t vol){ // Set volume.  Both left and right.
+    lock_t lck(m_mutex);
     if (vol > m_vol_steps) vol = m_vol_steps;
     m_vol = vol;
     uint8_t v1 = map(m_vol, 0, m_vol_steps, 0x01, 0xFF);
@@ -394,6 +556,7 @@ void VS1053::setVolume(uint8_t vol){ // Set volume.  Both left and right.
 }
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::setTone(uint8_t *rtone){                       // Set bass/treble (4 nibbles)
+    lock_t lck(m_mutex);
 
     // Set tone characteristics.  See documentation for the 4 nibbles.
     uint16_t value=0;                                       // Value to send to SCI_BASS
@@ -418,6 +581,7 @@ void VS1053::stopSong(){
     uint16_t modereg;                                       // Read from mode register
     int i;                                                  // Loop control
 
+    lock_t lck(m_mutex);
     setDatamode(AUDIO_NONE);
     m_f_webfile = false;
     m_f_webstream = false;
@@ -443,6 +607,7 @@ void VS1053::stopSong(){
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::softReset()
 {
+    lock_t lck(m_mutex);
     write_register(SCI_MODE, _BV (SM_SDINEW) | _BV(SM_RESET));
     delay(100);
     await_data_request();
@@ -450,6 +615,7 @@ void VS1053::softReset()
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::printDetails(const char* str){
 
+    lock_t lck(m_mutex);
     if(strlen(str) && vs1053_info) vs1053_info(str);
 
     char decbuf[16][6];
@@ -487,11 +653,13 @@ void VS1053::printDetails(const char* str){
 }
 //---------------------------------------------------------------------------------------------------------------------
 uint8_t VS1053::printVersion(){
+    lock_t lck(m_mutex);
     uint16_t reg = wram_read(0x1E02) & 0xFF;
     return reg;
 }
 
 uint32_t VS1053::printChipID(){
+    lock_t lck(m_mutex);
     uint32_t chipID = 0;
     chipID =  wram_read(0x1E00) << 16;
     chipID += wram_read(0x1E01);
@@ -500,7 +668,8 @@ uint32_t VS1053::printChipID(){
 //---------------------------------------------------------------------------------------------------------------------
 
 uint32_t VS1053::getBitRate(){
-    return (wram_read(0x1e05) & 0xFF) * 1000;  // Kbit/s => bit/s
+    lock_t lck(m_mutex);
+    return (uint32_t)wram_read(0x1e05) * 8;    // byteRate, average bytes/s => bit/s
 }
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::showstreamtitle(const char* ml) {
@@ -566,6 +735,9 @@ void VS1053::showstreamtitle(const char* ml) {
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::loop(){
 
+    if(m_loopTaskHandle && xTaskGetCurrentTaskHandle() != m_loopTaskHandle) return; // the loop task does the work
+    lock_t lck(m_mutex);
+    if(m_pendConn) processPendingConnection();
     if(!m_f_running) return;
 
     if(m_playlistFormat != FORMAT_M3U8){ // normal process
@@ -574,15 +746,16 @@ void VS1053::loop(){
                 processLocalFile();
                 break;
             case HTTP_RESPONSE_HEADER:
+                if(m_f_resumed) playAudioData(); // reconnected, play the buffered audio meanwhile
                 parseHttpResponseHeader();
                 break;
             case AUDIO_PLAYLISTINIT:
                 readPlayListData();
                 break;
             case AUDIO_PLAYLISTDATA:
-                if(m_playlistFormat == FORMAT_M3U)  connecttohost(parsePlaylist_M3U());
-                if(m_playlistFormat == FORMAT_PLS)  connecttohost(parsePlaylist_PLS());
-                if(m_playlistFormat == FORMAT_ASX)  connecttohost(parsePlaylist_ASX());
+                if(m_playlistFormat == FORMAT_M3U)  openHost(parsePlaylist_M3U(), "", "", false);
+                if(m_playlistFormat == FORMAT_PLS)  openHost(parsePlaylist_PLS(), "", "", false);
+                if(m_playlistFormat == FORMAT_ASX)  openHost(parsePlaylist_ASX(), "", "", false);
                 break;
             case AUDIO_DATA:
                 if(m_streamType == ST_WEBSTREAM) processWebStream();
@@ -597,7 +770,7 @@ void VS1053::loop(){
         case HTTP_RESPONSE_HEADER:
             playAudioData(); // fill I2S DMA buffer
             if(!parseHttpResponseHeader()){
-                if(m_f_timeout) connecttohost(m_lastHost);
+                if(m_f_timeout) openHost(m_lastHost, "", "", false);
             }
             m_codec = CODEC_AAC;
             break;
@@ -607,13 +780,25 @@ void VS1053::loop(){
             break;
         case AUDIO_PLAYLISTDATA:
             playAudioData(); // fill I2S DMA buffer
+            if(m_playlistContent.empty() && m_playlistURL.size() <= 1 && m_m3u8_targetDuration &&
+               millis() - m_m3u8ReloadTime >= m_m3u8_targetDuration * 1000) {
+                // the live playlist has new segments by now, fetch it before the known ones run out
+                m_m3u8ReloadTime = millis();
+                abrSwitch();
+                httpPrint(m_lastM3U8host ? m_lastM3U8host : m_lastHost);
+                setDatamode(HTTP_RESPONSE_HEADER);
+                break;
+            }
             host = parsePlaylist_M3U8();
             playAudioData(); // fill I2S DMA buffer
             if(host) { // host contains the next playlist URL
+                abrSegmentStart();
                 httpPrint(host);
             }
             else { // host == NULL means connect to m3u8 URL
-                httpPrint(m_lastM3U8host);
+                m_m3u8ReloadTime = millis();
+                abrSwitch();
+                httpPrint(m_lastM3U8host ? m_lastM3U8host : m_lastHost);
                 setDatamode(HTTP_RESPONSE_HEADER); // we have a new playlist now
             }
             break;
@@ -635,48 +820,46 @@ void VS1053::processLocalFile() {
     if(!(audiofile && m_f_running && getDatamode() == AUDIO_LOCALFILE)) return;
 
     int bytesDecoded = 0;
-    uint32_t bytesCanBeWritten = 0;
     uint32_t bytesCanBeRead = 0;
-    int32_t bytesAddedToBuffer = 0;
-    static bool f_stream;
+    bool& f_stream = m_plf.f_stream;
+    std::atomic<bool>& f_eof = m_plf.f_eof;
 
     if(m_f_firstCall) {  // runs only one time per connection, prepare for start
         m_f_firstCall = false;
         f_stream = false;
+        f_eof = false;
         return;
     }
 
     if(!f_stream && m_controlCounter == 100) {
         f_stream = true;
         if(vs1053_info) vs1053_info("stream ready");
+        if(m_codec == CODEC_MP3) {                          // InBuff starts with the first frame now
+            size_t n = min(InBuff.bufferFilled(), (size_t)InBuff.getMaxBlockSize());
+            readMP3Info(InBuff.getReadPtr(), n, m_audioDataStart, m_audioDataSize);
+        }
+        restartDecodeAt(0, false);
         if(m_resumeFilePos){
+            fileLock_t flck(this);                          // the reader task may already fill InBuff
             InBuff.resetBuffer();
             setFilePos(m_resumeFilePos);
             log_i("m_resumeFilePos %i", m_resumeFilePos);
         }
+        m_f_localAudio = true;                              // the reader task takes over from here
+        readerWake();
     }
 
-    bytesCanBeWritten = InBuff.writeSpace();
-
-    //----------------------------------------------------------------------------------------------------
-    // some files contain further data after the audio block (e.g. pictures).
-    // In that case, the end of the audio block is not the end of the file. An 'eof' has to be forced.
-    if((m_controlCounter == 100) && (m_contentlength > 0)) { // fileheader was read
-           if(bytesCanBeWritten + getFilePos() >= m_contentlength){
-               if(m_contentlength > getFilePos()) bytesCanBeWritten = m_contentlength - getFilePos();
-               else bytesCanBeWritten = 0;
-           }
-    }
-    //----------------------------------------------------------------------------------------------------
-    bytesAddedToBuffer = audiofile.read(InBuff.getWritePtr(), bytesCanBeWritten);
-    if(bytesAddedToBuffer > 0) {
-        InBuff.bytesWritten(bytesAddedToBuffer);
+    // with the reader task running, this function only feeds the decoder, the header is still read from here
+    if(!m_readerTaskHandle || !m_f_localAudio) readLocalBlock();
+    bool eof = f_eof;                                       // set after the last block is committed to InBuff
+    if(!eof && m_readerTaskHandle && m_f_localAudio && InBuff.freeSpace() >= localReadBlock()) readerWake();
+    if(eof && InBuff.freeSpace() && m_controlCounter == 100 && !m_playQueue.empty()) {
+        if(appendNextFile()) return; // eof, the next track follows without a gap
     }
-
-    if(bytesAddedToBuffer == -1) bytesAddedToBuffer = 0; // read error? eof?
     bytesCanBeRead = InBuff.bufferFilled();
     if(bytesCanBeRead > InBuff.getMaxBlockSize()) bytesCanBeRead = InBuff.getMaxBlockSize();
-    if(bytesCanBeRead == InBuff.getMaxBlockSize()) { // mp3 or aac frame complete?
+    bool f_m4aTail = eof && m_codec == CODEC_M4A && m_controlCounter != 100; // moov ends with the file
+    if(bytesCanBeRead == InBuff.getMaxBlockSize() || f_m4aTail) { // mp3 or aac frame complete?
 
         if(m_controlCounter != 100){
             if(m_codec == CODEC_WAV){
@@ -691,11 +874,13 @@ void VS1053::processLocalFile() {
                 }
             }
             if(m_codec == CODEC_M4A){
-            //     int res = read_M4A_Header(InBuff.getReadPtr(), bytesCanBeRead);
-            //     if(res >= 0) bytesDecoded = res;
-            //     else{ // error, skip header
+                int cc = m_controlCounter;
+                int res = read_M4A_Header(InBuff.getReadPtr(), bytesCanBeRead);
+                if(res == 0 && f_m4aTail && cc && cc == m_controlCounter && m_plf.f_eof) res = m4aError("truncated file");
+                if(res >= 0) bytesDecoded = res;
+                else{ // error, the decoder gets the file as it is
                     m_controlCounter = 100;
-            //     }
+                }
             }
             if(m_codec == CODEC_AAC){
                 // stream only, no header
@@ -704,12 +889,11 @@ void VS1053::processLocalFile() {
             }
 
             if(m_codec == CODEC_FLAC){
-            //     int res = read_FLAC_Header(InBuff.getReadPtr(), bytesCanBeRead);
-            //     if(res >= 0) bytesDecoded = res;
-            //     else{ // error, skip header
-            //         stopSong();
+                int res = read_FLAC_Header(InBuff.getReadPtr(), bytesCanBeRead);
+                if(res >= 0) bytesDecoded = res;
+                else{ // error, no fLaC signature, the decoder gets it as it is
                     m_controlCounter = 100;
-            //     }
+                }
             }
 
             if(m_codec == CODEC_OGG){
@@ -717,23 +901,23 @@ void VS1053::processLocalFile() {
             }
         }
         else {
-            bytesDecoded = sendBytes(InBuff.getReadPtr(), bytesCanBeRead);
+            gaplessAdvance(sendSpan(bytesCanBeRead));
+            return;
         }
         if(bytesDecoded > 0) {InBuff.bytesWasRead(bytesDecoded);}
         return;
     }
 
-    if(!bytesAddedToBuffer) {  // eof
+    if(eof) {
         bytesCanBeRead = InBuff.bufferFilled();
         if(bytesCanBeRead > 200){
             if(bytesCanBeRead > InBuff.getMaxBlockSize()) bytesCanBeRead = InBuff.getMaxBlockSize();
-            bytesDecoded = sendBytes(InBuff.getReadPtr(), bytesCanBeRead); // play last chunk(s)
-            if(bytesDecoded > 0){
-                InBuff.bytesWasRead(bytesDecoded);
-                return;
-            }
+            bytesDecoded = sendSpan(bytesCanBeRead); // play last chunk(s)
+            gaplessAdvance(bytesDecoded);
+            if(bytesDecoded > 0) return;
         }
         InBuff.resetBuffer();
+        gaplessAdvance(UINT32_MAX);                         // a short next track, its start is discarded too
 
         // if(m_f_loop  && f_stream){  //eof
         //     sprintf(m_chbuf, "loop from: %u to: %u", getFilePos(), m_audioDataStart);  //TEST loop
@@ -760,41 +944,265 @@ void VS1053::processLocalFile() {
         if(vs1053_info) vs1053_info(m_chbuf);
         if(vs1053_eof_mp3) vs1053_eof_mp3(afn);
         if(afn) free(afn);
+        playNextInQueue();
+    }
+}
+//----------------------------------------------------------------------------------------------------------------------
+size_t VS1053::readLocalBlock(){
+    // called from processLocalFile() or from the reader task, returns the number of bytes added to InBuff
+    // the file is read in fixed blocks that start and end on block boundaries of the file, so the SD or FFat
+    // driver can transfer whole sectors and clusters. A read waits until the whole block fits into InBuff,
+    // only the first one after a seek is shorter (up to the next boundary), and the last one at the end.
+    // some files contain further data after the audio block (e.g. pictures).
+    // In that case, the end of the audio block is not the end of the file. An 'eof' has to be forced.
+    // m_fileMutex is not held during the read, so processLocalFile() never waits for the card. A seek or close
+    // (fileLock_t) waits for the read instead and the block is dropped.
+    std::atomic<bool>& f_eof = m_plf.f_eof;
+    uint32_t pos, end, gen;
+    size_t want;
+    AudioBuffer::span_t sp;
+    {
+        lock_t flck(m_fileMutex);
+        if(!audiofile || f_eof || getDatamode() != AUDIO_LOCALFILE) return 0;
+        pos = audiofile.position();
+        end = audiofile.size();
+        if(m_f_localAudio && (m_contentlength > 0) && m_contentlength < end) end = m_contentlength;
+        size_t blk = localReadBlock();
+        want = blk - pos % blk;
+        if(pos >= end) {f_eof = true; return 0;}
+        if(want > end - pos) want = end - pos;
+        if(InBuff.freeSpace() < want) return 0;
+        sp = InBuff.reserve(want);
+        gen = m_fileGen;
+        m_f_fileBusy = true;
+    }
+    int32_t res = audiofile.read(sp.ptr1, sp.len1);
+    if(res == (int32_t)sp.len1 && sp.len2) {
+        int32_t res2 = audiofile.read(sp.ptr2, sp.len2);
+        if(res2 > 0) res += res2;
+    }
+    m_f_fileBusy = false;
+    lock_t flck(m_fileMutex);
+    if(gen != m_fileGen) return 0;                          // seeked or closed meanwhile, InBuff is reset
+    if(res > 0) InBuff.commit(res);
+    else res = 0;
+    if(res < (int32_t)want) f_eof = true;                   // read error or the file is shorter than its size
+    else if(pos + want >= end) f_eof = true;
+    return res;
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::startReaderTask(uint8_t core, uint8_t prio, uint32_t stackSize){
+    // optional: local files are read into InBuff from an own task, SD latency (FAT chain walks, the garbage
+    // collection of the card) then doesn't hold up the decoder feed. Useful for FLAC and WAV, InBuff should be
+    // in PSRAM. The file header is still read by loop(), the task takes over when the audio data starts.
+    if(m_readerTaskHandle) return true;
+    if(!m_fileMutex) {log_e("oom"); return false;}
+    m_f_readerTaskStop = false;
+    BaseType_t res = xTaskCreatePinnedToCore(readerTask, "vs1053_reader", stackSize, this, prio, &m_readerTaskHandle, core);
+    if(res != pdPASS) {m_readerTaskHandle = NULL; log_e("can't create the reader task"); return false;}
+    AUDIO_INFO("reader task started on core %d, priority %d", core, prio);
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------------------
+void VS1053::stopReaderTask(){
+    if(!m_readerTaskHandle) return;
+    m_f_readerTaskStop = true;
+    readerWake();
+    while(m_readerTaskHandle) vTaskDelay(5);                // the task deletes itself after the current block
+}
+//----------------------------------------------------------------------------------------------------------------------
+void VS1053::readerTask(void* param){
+    // sleeps until processLocalFile() has room for a block, or connecttoFS(), setFilePos() or stopReaderTask()
+    // have something new
+    VS1053* vs = (VS1053*)param;
+    while(!vs->m_f_readerTaskStop){
+        size_t n = 0;
+        if(vs->m_f_localAudio) n = vs->readLocalBlock();
+        if(!n) ulTaskNotifyTake(pdTRUE, portMAX_DELAY);     // InBuff is full, eof or no local file
+    }
+    vs->m_readerTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+//----------------------------------------------------------------------------------------------------------------------
+size_t VS1053::localReadBlock(){
+    // m_lfBlock, but at most half of InBuff (without PSRAM 14400 bytes), a multiple of 512
+    size_t blk = min((size_t)m_lfBlock, (InBuff.bufferFilled() + InBuff.freeSpace()) / 2);
+    blk &= ~(size_t)511;
+    return blk ? blk : 512;
+}
+//----------------------------------------------------------------------------------------------------------------------
+void VS1053::setLocalReadBlock(uint16_t size){
+    // 16...32KB suit SD and SD_MMC with 32KB clusters, smaller blocks reduce the latency of setFilePos()
+    lock_t lck(m_mutex);
+    size &= ~511;
+    m_lfBlock = size ? size : 512;
+}
+//----------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::benchmarkFS(fs::FS &fs, const char* path, uint16_t blockSize){
+    // reads the whole file in blocks of blockSize (0 = the block size of the player) and reports the sustained
+    // rate, e.g. to compare SD, SD_MMC, FFat and SPIFFS. Blocks the caller, don't run it while playing from fs.
+    if(!blockSize) blockSize = localReadBlock();
+    File f = fs.open(path);
+    if(!f) {AUDIO_INFO("benchmark: can't open \"%s\"", path); return 0;}
+    uint8_t* buf = (uint8_t*)(psramFound() ? ps_malloc(blockSize) : malloc(blockSize));
+    if(!buf) {f.close(); log_e("out of memory"); return 0;}
+    uint32_t total = 0;
+    uint32_t t0 = millis();
+    while(true) {
+        int32_t res = f.read(buf, blockSize);
+        if(res <= 0) break;
+        total += res;
+    }
+    uint32_t dt = millis() - t0;
+    f.close();
+    free(buf);
+    if(!dt) dt = 1;
+    uint32_t kbs = (uint64_t)total * 1000 / 1024 / dt;
+    AUDIO_INFO("benchmark \"%s\": %u KB in %u ms, block %u, %u.%02u MB/s", path, total / 1024, dt, blockSize,
+               kbs / 1024, (kbs % 1024) * 100 / 1024);
+    return kbs;
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::addToPlayQueue(fs::FS &fs, const char* path){
+    lock_t lck(m_mutex);
+    if(!path || strlen(path) > 255) return false;
+    m_playQueue.push_back(strdup(path));
+    m_playQueueFS.push_back(&fs);
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::addToPlayQueue(const char* url){
+    lock_t lck(m_mutex);
+    if(!url || !strlen(url)) return false;
+    m_playQueue.push_back(strdup(url));
+    m_playQueueFS.push_back(NULL);
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------------------
+void VS1053::clearPlayQueue(){
+    lock_t lck(m_mutex);
+    vector_clear_and_shrink(m_playQueue);
+    m_playQueueFS.clear(); m_playQueueFS.shrink_to_fit();
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::appendNextFile(){
+    // gapless: if the next queued entry is a local file with the same codec (mp3 or aac), it is read into InBuff
+    // directly behind the current file. The decoder is not stopped, the ID3v2 tag is skipped, not parsed.
+    // URLs are never opened ahead, they follow after the end of the current track as with playNextInQueue().
+    // The new file is read from now on, the track information switches when its first byte is sent, see
+    // gaplessAdvance().
+    if(m_playQueue.empty() || !m_playQueueFS[0]) return false;
+    if(m_gapless.prevName) return false;                    // the previous boundary is still in InBuff
+    if(m_codec != CODEC_MP3 && m_codec != CODEC_AAC) return false;
+
+    char ext[6] = {0};
+    const char* dot = strrchr(m_playQueue[0], '.');
+    if(!dot || strlen(dot) > 5) return false;
+    for(uint8_t i = 0; i < strlen(dot); i++) ext[i] = toLowerCase(dot[i]);
+    if(m_codec == CODEC_MP3 && strcmp(ext, ".mp3")) return false;
+    if(m_codec == CODEC_AAC && strcmp(ext, ".aac")) return false;
+
+    char path[257];
+    if(m_playQueue[0][0] != '/') {path[0] = '/'; strcpy(path + 1, m_playQueue[0]);}
+    else strcpy(path, m_playQueue[0]);
+    File f = m_playQueueFS[0]->open(path);
+    if(!f) return false;                                    // playNextInQueue() reports it
+
+    uint32_t audioStart = 0;
+    uint32_t audioEnd = f.size();
+    uint8_t  hdr[10];
+    if(m_codec == CODEC_MP3){
+        if(f.read(hdr, 10) == 10 && !memcmp(hdr, "ID3", 3)) {
+            audioStart = 10 + ((hdr[6] & 0x7F) << 21 | (hdr[7] & 0x7F) << 14 | (hdr[8] & 0x7F) << 7 | (hdr[9] & 0x7F));
+            if(hdr[5] & 0x10) audioStart += 10;             // footer present
+        }
+        if(audioEnd > 128 + audioStart && f.seek(audioEnd - 128) && f.read(hdr, 3) == 3 && !memcmp(hdr, "TAG", 3)) {
+            audioEnd -= 128;                                // ID3v1 tag is not sent to the decoder
+        }
+    }
+    if(audioStart >= audioEnd || !f.seek(audioStart)) {f.close(); return false;}
+    mp3Info_t mp3 = {};
+    if(m_codec == CODEC_MP3) {                              // for setAudioPlayPosition() in the new track
+        uint8_t* buf = (uint8_t*)malloc(InBuff.getMaxBlockSize());
+        if(buf) {
+            mp3Info_t cur = m_mp3;                          // readMP3Info() writes m_mp3
+            int32_t n = f.read(buf, InBuff.getMaxBlockSize());
+            readMP3Info(buf, n > 0 ? n : 0, audioStart, audioEnd - audioStart);
+            mp3 = m_mp3;
+            m_mp3 = cur;
+            free(buf);
+        }
+        if(!f.seek(audioStart)) {f.close(); return false;}
     }
+
+    fileLock_t flck(this);
+    m_gapless.left = InBuff.bufferFilled();                 // the rest of the current track
+    m_gapless.prevName = strdup(audiofile.name());
+    m_gapless.mp3 = mp3;
+    m_gapless.dataStart = audioStart;
+    m_gapless.dataSize = audioEnd - audioStart;
+    audiofile.close();
+    audiofile = f;
+    m_file_size = audioEnd;                                 // the read side, readLocalBlock() stops here
+    m_contentlength = audioEnd;
+    m_plf.f_eof = false;
+    free(m_playQueue[0]);
+    m_playQueue.erase(m_playQueue.begin());
+    m_playQueueFS.erase(m_playQueueFS.begin());
+    if(!m_gapless.left) gaplessAdvance(0);
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------------------
+void VS1053::gaplessAdvance(size_t bytesSent){
+    // counts the bytes of the previous track that are sent to the decoder, when they are all gone the next
+    // track is playing: vs1053_eof_mp3() for the previous one, the duration and seek data of the new one
+    if(!m_gapless.prevName) return;
+    if(bytesSent < m_gapless.left) {m_gapless.left -= bytesSent; return;}
+    m_gapless.left = 0;
+    m_mp3 = m_gapless.mp3;
+    m_audioDataStart = m_gapless.dataStart;
+    m_audioDataSize = m_gapless.dataSize;
+    restartDecodeAt(0, false);                              // InBuff holds the new track already
+    char* afn = m_gapless.prevName;
+    m_gapless.prevName = NULL;
+    AUDIO_INFO("End of file \"%s\", gapless to \"%s\"", afn, audiofile.name());
+    if(vs1053_eof_mp3) vs1053_eof_mp3(afn);
+    free(afn);
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::playNextInQueue(){
+    // not gapless, the next entry is started like a new connection
+    while(!m_playQueue.empty()){
+        char* entry = m_playQueue[0];
+        fs::FS* fs = m_playQueueFS[0];
+        m_playQueue.erase(m_playQueue.begin());
+        m_playQueueFS.erase(m_playQueueFS.begin());
+        bool res = fs ? openFile(*fs, entry) : openHost(entry, "", "", false); // the rest of the queue stays
+        free(entry);
+        if(res) return true;
+    }
+    return false;
 }
 //----------------------------------------------------------------------------------------------------------------------
 void VS1053::processWebStream() {
 
     const uint16_t  maxFrameSize = InBuff.getMaxBlockSize();    // every mp3/aac frame is not bigger
-    static bool     f_stream;                                   // first audio data received
-    static uint32_t chunkSize;                                  // chunkcount read from stream
-    static uint32_t muteTime;
-    static bool     f_mute;
+    bool& f_stream = m_pwst.f_stream;                           // first audio data received
+    uint32_t& muteTime = m_pwst.muteTime;
+    bool& f_mute = m_pwst.f_mute;
 
     // first call, set some values to default  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_f_firstCall) { // runs only ont time per connection, prepare for start
         m_f_firstCall = false;
-        f_stream = false;
-        chunkSize = 0;
-        m_metacount = m_metaint;
-        readMetadata(0, true); // reset all static vars
+        if(!m_f_resumed) f_stream = false;  // after a reconnect InBuff plays on
+        m_f_resumed = false;
+        m_metacount = m_metaint;            // the metadata intervals start again with the new response
+        m_rmet = {};                        // readMetadata()
         f_mute = false;
     }
 
     if(getDatamode() != AUDIO_DATA) return;              // guard
-    uint32_t availableBytes = _client->available();      // available from stream
-
-    // chunked data tramsfer - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-    if(m_f_chunked && availableBytes){
-        uint8_t readedBytes = 0;
-        if(!chunkSize) chunkSize = chunkedDataTransfer(&readedBytes);
-        availableBytes = min(availableBytes, chunkSize);
-    }
-    // we have metadata  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-    if(m_f_metadata && availableBytes){
-        if(m_metacount == 0) {chunkSize -= readMetadata(availableBytes); return;}
-        availableBytes = min(availableBytes, m_metacount);
-    }
+    uint32_t availableBytes = streamAvail();             // available from stream, chunk headers are consumed here
 
     // if the buffer is often almost empty issue a warning - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(f_stream){
@@ -803,16 +1211,10 @@ void VS1053::processWebStream() {
 
     // buffer fill routine - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(availableBytes) {
-        availableBytes = min(availableBytes, (uint32_t)InBuff.writeSpace());
-        int16_t bytesAddedToBuffer = _client->read(InBuff.getWritePtr(), availableBytes);
+        availableBytes = min(availableBytes, (uint32_t)InBuff.freeSpace());
+        demuxToInBuff(availableBytes);  // audio to InBuff, metadata to readMetadata()
 
-        if(bytesAddedToBuffer > 0) {
-            if(m_f_metadata)            m_metacount  -= bytesAddedToBuffer;
-            if(m_f_chunked)             chunkSize    -= bytesAddedToBuffer;
-            InBuff.bytesWritten(bytesAddedToBuffer);
-        }
-
-        if(InBuff.bufferFilled() > maxFrameSize && !f_stream) {  // waiting for buffer filled
+        if(!f_stream && bufferReady(false, false)) {  // waiting for buffer filled
             f_stream = true;  // ready to play the audio data
             muteTime = millis();
             f_mute = true;
@@ -834,7 +1236,8 @@ void VS1053::processWebStream() {
         if(f_mute) {
             if((muteTime + 200) < millis()) {setVolume(m_vol); f_mute = false;}
         }
-        static uint8_t cnt = 0;
+        if(!bufferReady(true, false)) return;
+        uint8_t& cnt = m_pwst.cnt;
         cnt++;
         if(cnt == 3){playAudioData(); cnt = 0;}
     }
@@ -844,18 +1247,17 @@ void VS1053::processWebStreamTS() {
 
     const uint16_t  maxFrameSize = InBuff.getMaxBlockSize();    // every mp3/aac frame is not bigger
     uint32_t        availableBytes;                             // available bytes in stream
-    static bool     f_stream;                                   // first audio data received
-    static bool     f_firstPacket;
-    static bool     f_chunkFinished;
-    static uint32_t byteCounter;                                // count received data
-    static uint8_t  ts_packet[188];                             // m3u8 transport stream is 188 bytes long
+    bool& f_stream = m_pwsts.f_stream;                          // first audio data received
+    bool& f_firstPacket = m_pwsts.f_firstPacket;
+    bool& f_chunkFinished = m_pwsts.f_chunkFinished;
+    uint32_t& byteCounter = m_pwsts.byteCounter;                // count received data
+    uint8_t (&ts_packet)[188] = m_pwsts.ts_packet;              // m3u8 transport stream is 188 bytes long
     uint8_t         ts_packetStart = 0;
     uint8_t         ts_packetLength = 0;
-    static uint8_t  ts_packetPtr = 0;
+    uint8_t& ts_packetPtr = m_pwsts.ts_packetPtr;
     const uint8_t   ts_packetsize = 188;
-    static size_t   chunkSize = 0;
-    static uint32_t muteTime;
-    static bool     f_mute;
+    uint32_t& muteTime = m_pwsts.muteTime;
+    bool& f_mute = m_pwsts.f_mute;
 
     // first call, set some values to default - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_f_firstCall) { // runs only ont time per connection, prepare for start
@@ -863,7 +1265,6 @@ void VS1053::processWebStreamTS() {
         f_firstPacket = true;
         f_chunkFinished = false;
         byteCounter = 0;
-        chunkSize = 0;
         m_t0 = millis();
         ts_packetPtr = 0;
         m_controlCounter = 0;
@@ -872,14 +1273,13 @@ void VS1053::processWebStreamTS() {
     }
 
     if(getDatamode() != AUDIO_DATA) return;        // guard
+    abrTick();
 
     if(InBuff.freeSpace() < maxFrameSize && f_stream){playAudioData(); return;}
 
-    availableBytes = _client->available();
+    availableBytes = streamAvail();
     if(availableBytes){
-        uint8_t readedBytes = 0;
-        if(m_f_chunked) chunkSize = chunkedDataTransfer(&readedBytes);
-        int res = _client->read(ts_packet + ts_packetPtr, ts_packetsize - ts_packetPtr);
+        int res = streamRead(ts_packet + ts_packetPtr, ts_packetsize - ts_packetPtr);
         if(res > 0){
             ts_packetPtr += res;
             byteCounter += res;
@@ -902,31 +1302,20 @@ void VS1053::processWebStreamTS() {
             ts_parsePacket(&ts_packet[0], &ts_packetStart, &ts_packetLength);
 
             if(ts_packetLength) {
-                size_t ws = InBuff.writeSpace();
-                if(ws >= ts_packetLength){
-                    memcpy(InBuff.getWritePtr(), ts_packet + ts_packetStart, ts_packetLength);
-                    InBuff.bytesWritten(ts_packetLength);
-                }
-                else{
-                    memcpy(InBuff.getWritePtr(), ts_packet + ts_packetStart, ws);
-                    InBuff.bytesWritten(ws);
-                    memcpy(InBuff.getWritePtr(), &ts_packet[ws + ts_packetStart], ts_packetLength -ws);
-                    InBuff.bytesWritten(ts_packetLength -ws);
-                }
+                writeToInBuff(ts_packet + ts_packetStart, ts_packetLength); // PES payload, split at the wraparound
             }
-            if(byteCounter == m_contentlength  || byteCounter == chunkSize){
+            if(byteCounter == m_contentlength || chunkedEnd()){
                 f_chunkFinished = true;
+                m_m3u8SegmentSize = byteCounter;
+                abrSegmentDone(byteCounter);
                 byteCounter = 0;
             }
             if(byteCounter > m_contentlength) log_e("byteCounter overflow");
         }
 
     }
-    if(f_chunkFinished) {
-        if(m_f_psramFound) {
-            if(InBuff.bufferFilled() < 50000) { f_chunkFinished = false; m_f_continue = true;}
-        }
-        else {
+    if(f_chunkFinished) {  // segment complete, request the next one when m3u8EarlyRequest() allows it
+        if(m3u8EarlyRequest()) {
             f_chunkFinished = false;
             m_f_continue = true;
         }
@@ -939,7 +1328,7 @@ void VS1053::processWebStreamTS() {
 
     // buffer fill routine  - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(true) { // statement has no effect
-        if(InBuff.bufferFilled() > maxFrameSize && !f_stream) {  // waiting for buffer filled
+        if(!f_stream && bufferReady(false, false)) {  // waiting for buffer filled
             f_stream = true;  // ready to play the audio data
             uint16_t filltime = millis() - m_t0;
             muteTime = millis();
@@ -955,7 +1344,8 @@ void VS1053::processWebStreamTS() {
         if(f_mute) {
             if((muteTime + 200) < millis()) {setVolume(m_vol); f_mute = false;}
         }
-        static uint8_t cnt = 0;
+        if(!bufferReady(true, false)) return;
+        uint8_t& cnt = m_pwsts.cnt;
         cnt++;
         if(cnt == 1){playAudioData(); cnt = 0;} // aac only
     }
@@ -967,44 +1357,41 @@ void VS1053::processWebStreamHLS() {
    const uint16_t  maxFrameSize = InBuff.getMaxBlockSize();    // every mp3/aac frame is not bigger
     uint16_t  ID3BuffSize = 1024; if(m_f_psramFound) ID3BuffSize = 4096;
     uint32_t        availableBytes;                             // available bytes in stream
-    static bool     f_stream;                                   // first audio data received
-    static bool     firstBytes;
-    static bool     f_chunkFinished;
-    static uint32_t byteCounter;                                // count received data
-    static size_t   chunkSize = 0;
-    static uint16_t ID3WritePtr;
-    static uint16_t ID3ReadPtr;
-    static uint8_t* ID3Buff;
-    static uint32_t muteTime;
-    static bool     f_mute;
+    bool& f_stream = m_pwsHLS.f_stream;                         // first audio data received
+    bool& firstBytes = m_pwsHLS.firstBytes;
+    bool& f_chunkFinished = m_pwsHLS.f_chunkFinished;
+    uint32_t& byteCounter = m_pwsHLS.byteCounter;               // count received data
+    uint16_t& ID3WritePtr = m_pwsHLS.ID3WritePtr;
+    uint16_t& ID3ReadPtr = m_pwsHLS.ID3ReadPtr;
+    uint8_t*& ID3Buff = m_pwsHLS.ID3Buff;
+    uint32_t& muteTime = m_pwsHLS.muteTime;
+    bool& f_mute = m_pwsHLS.f_mute;
 
     // first call, set some values to default - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_f_firstCall) { // runs only ont time per connection, prepare for start
         f_stream = false;
         f_chunkFinished = false;
         byteCounter = 0;
-        chunkSize = 0;
         ID3WritePtr = 0;
         ID3ReadPtr = 0;
         m_t0 = millis();
         m_f_firstCall = false;
         firstBytes = true;
+        if(ID3Buff) free(ID3Buff);                              // left over from an interrupted segment
         ID3Buff = (uint8_t*)malloc(ID3BuffSize);
         m_controlCounter = 0;
         f_mute = false;
     }
 
     if(getDatamode() != AUDIO_DATA) return;        // guard
+    abrTick();
 
-    availableBytes = _client->available();
+    availableBytes = streamAvail();
     if(availableBytes){ // an ID3 header could come here
-        uint8_t readedBytes = 0;
-
-        if(m_f_chunked && !chunkSize) {chunkSize = chunkedDataTransfer(&readedBytes); byteCounter += readedBytes;}
 
         if(firstBytes){
             if(ID3WritePtr < ID3BuffSize){
-                ID3WritePtr += _client->readBytes(&ID3Buff[ID3WritePtr], ID3BuffSize - ID3WritePtr);
+                ID3WritePtr += streamRead(&ID3Buff[ID3WritePtr], ID3BuffSize - ID3WritePtr);
                 return;
             }
             if(m_controlCounter < 100){
@@ -1015,45 +1402,27 @@ void VS1053::processWebStreamHLS() {
             }
             if(m_controlCounter != 100) return;
 
-            size_t ws = InBuff.writeSpace();
-            if(ws >= ID3BuffSize - ID3ReadPtr){
-                memcpy(InBuff.getWritePtr(), &ID3Buff[ID3ReadPtr], ID3BuffSize - ID3ReadPtr);
-                InBuff.bytesWritten(ID3BuffSize - ID3ReadPtr);
-            }
-            else{
-                memcpy(InBuff.getWritePtr(), &ID3Buff[ID3ReadPtr], ws);
-                InBuff.bytesWritten(ws);
-                memcpy(InBuff.getWritePtr(), &ID3Buff[ws + ID3ReadPtr], ID3BuffSize - (ID3ReadPtr + ws));
-                InBuff.bytesWritten(ID3BuffSize - (ID3ReadPtr + ws));
-            }
+            writeToInBuff(&ID3Buff[ID3ReadPtr], ID3BuffSize - ID3ReadPtr);
             if(ID3Buff) free(ID3Buff);
             byteCounter += ID3BuffSize;
             ID3Buff = NULL;
             firstBytes = false;
         }
 
-        size_t bytesWasWritten = 0;
-        if(InBuff.writeSpace() >= availableBytes){
-            bytesWasWritten = _client->read(InBuff.getWritePtr(), availableBytes);
-        }
-        else{
-            bytesWasWritten = _client->read(InBuff.getWritePtr(), InBuff.writeSpace());
-        }
-        InBuff.bytesWritten(bytesWasWritten);
+        size_t bytesWasWritten = readToInBuff(min(availableBytes, (uint32_t)InBuff.freeSpace()));
 
         byteCounter += bytesWasWritten;
 
-        if(byteCounter == m_contentlength || byteCounter == chunkSize){
+        if(byteCounter == m_contentlength || chunkedEnd()){
             f_chunkFinished = true;
+            m_m3u8SegmentSize = byteCounter;
+            abrSegmentDone(byteCounter);
             byteCounter = 0;
         }
     }
 
-    if(f_chunkFinished) {
-        if(m_f_psramFound) {
-            if(InBuff.bufferFilled() < 50000) {f_chunkFinished = false; m_f_continue = true;}
-        }
-        else {
+    if(f_chunkFinished) {  // segment complete, request the next one when m3u8EarlyRequest() allows it
+        if(m3u8EarlyRequest()) {
             f_chunkFinished = false;
             m_f_continue = true;
         }
@@ -1064,7 +1433,7 @@ void VS1053::processWebStreamHLS() {
         if(streamDetection(availableBytes)) return;
     }
 
-    if(InBuff.bufferFilled() > maxFrameSize && !f_stream) {  // waiting for buffer filled
+    if(!f_stream && bufferReady(false, false)) {  // waiting for buffer filled
         f_stream = true;  // ready to play the audio data
         uint16_t filltime = millis() - m_t0;
         if(m_f_Log) AUDIO_INFO("stream ready");
@@ -1076,7 +1445,8 @@ void VS1053::processWebStreamHLS() {
         if(f_mute) {
             if((muteTime + 200) < millis()) {setVolume(m_vol); f_mute = false;}
         }
-        static uint8_t cnt = 0;
+        if(!bufferReady(true, false)) return;
+        uint8_t& cnt = m_pwsHLS.cnt;
         cnt++;
         if(cnt == 1){playAudioData(); cnt = 0;} // aac only
     }
@@ -1086,57 +1456,47 @@ void VS1053::processWebStreamHLS() {
 void VS1053::processWebFile(){
 
     const uint32_t  maxFrameSize = InBuff.getMaxBlockSize();    // every mp3/aac frame is not bigger
-    static bool     f_stream;                                   // first audio data received
-    static bool     f_webFileDataComplete;                      // all file data received
-    static uint32_t byteCounter;                                // count received data
-    static uint32_t chunkSize;                                  // chunkcount read from stream
-    static size_t   audioDataCount;                             // counts the decoded audiodata only
-    static uint32_t muteTime;
-    static bool     f_mute;
+    bool& f_stream = m_pwf.f_stream;                            // first audio data received
+    bool& f_webFileDataComplete = m_pwf.f_webFileDataComplete;  // all file data received
+    uint32_t& byteCounter = m_pwf.byteCounter;                  // count received data
+    size_t& audioDataCount = m_pwf.audioDataCount;              // counts the decoded audiodata only
+    uint32_t& muteTime = m_pwf.muteTime;
+    bool& f_mute = m_pwf.f_mute;
 
     // first call, set some values to default - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_f_firstCall) { // runs only ont time per connection, prepare for start
         m_f_firstCall = false;
         m_t0 = millis();
         f_webFileDataComplete = false;
-        f_stream = false;
+        if(!m_f_resumed) f_stream = false;  // after a reconnect InBuff plays on
+        m_f_resumed = false;
         byteCounter = 0;
-        chunkSize = 0;
         audioDataCount = 0;
         f_mute = false;
     }
 
-    if(!m_contentlength && !m_f_tts) {log_e("webfile without contentlength!"); stopSong(); return;} // guard
+    if(!m_contentlength && !m_f_tts && !m_f_chunked) {log_e("webfile without contentlength!"); stopSong(); return;} // guard
 
-    uint32_t availableBytes = _client->available(); // available from stream
-
-    // chunked data tramsfer - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-    if(m_f_chunked){
-        uint8_t readedBytes = 0;
-        if(!chunkSize) chunkSize = chunkedDataTransfer(&readedBytes);
-        availableBytes = min(availableBytes, chunkSize);
-        if(m_f_tts) m_contentlength = chunkSize;
-    }
+    uint32_t availableBytes = streamAvail(); // available from stream, chunk headers are consumed here
 
     // if the buffer is often almost empty issue a warning - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(!f_webFileDataComplete && f_stream){
         if(streamDetection(availableBytes)) return;
     }
 
-    availableBytes = min((uint32_t)InBuff.writeSpace(), availableBytes);
-    availableBytes = min(m_contentlength - byteCounter, availableBytes);
+    availableBytes = min((uint32_t)InBuff.freeSpace(), availableBytes);
+    if(m_contentlength) availableBytes = min(m_contentlength - byteCounter, availableBytes);
     if(m_audioDataSize) availableBytes = min(m_audioDataSize - (byteCounter - m_audioDataStart), availableBytes);
 
-    int16_t bytesAddedToBuffer = _client->read(InBuff.getWritePtr(), availableBytes);
+    int32_t bytesAddedToBuffer = readToInBuff(availableBytes);
 
      if(bytesAddedToBuffer > 0) {
         byteCounter  += bytesAddedToBuffer;  // Pull request #42
-        if(m_f_chunked)             m_chunkcount   -= bytesAddedToBuffer;
         if(m_controlCounter == 100) audioDataCount += bytesAddedToBuffer;
-        InBuff.bytesWritten(bytesAddedToBuffer);
     }
 
-    if(InBuff.bufferFilled() > maxFrameSize && !f_stream) {  // waiting for buffer filled
+    bool f_eof = (m_contentlength && byteCounter == m_contentlength) || chunkedEnd(); // all received
+    if(!f_stream && bufferReady(false, f_eof)) {  // waiting for buffer filled
         f_stream = true;  // ready to play the audio data
         muteTime = millis();
         f_mute = true;
@@ -1158,7 +1518,7 @@ void VS1053::processWebFile(){
     // // if we have a webfile, read the file header first - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_streamType == ST_WEBFILE && m_controlCounter != 100){
         int32_t bytesRead = 0;
-        if(InBuff.bufferFilled() < maxFrameSize) return;
+        if(InBuff.bufferFilled() < maxFrameSize && !f_eof) return;
          if(m_codec == CODEC_WAV){
             m_controlCounter = 100;
         }
@@ -1168,10 +1528,14 @@ void VS1053::processWebFile(){
             else{m_controlCounter = 100;} // error, skip header
         }
         if(m_codec == CODEC_M4A){
-            m_controlCounter = 100;
+            int res = read_M4A_Header(InBuff.getReadPtr(), min(InBuff.bufferFilled(), (size_t)InBuff.getMaxBlockSize()));
+            if(res >= 0) bytesRead = res;
+            else{m_controlCounter = 100;} // error, the decoder gets the file as it is
         }
         if(m_codec == CODEC_FLAC){
-            m_controlCounter = 100;
+            int res = read_FLAC_Header(InBuff.getReadPtr(), min(InBuff.bufferFilled(), (size_t)InBuff.getMaxBlockSize()));
+            if(res >= 0) bytesRead = res;
+            else{m_controlCounter = 100;} // error, no fLaC signature
         }
         if(m_codec == CODEC_VORBIS){
             m_controlCounter = 100;
@@ -1184,8 +1548,8 @@ void VS1053::processWebFile(){
     if(f_webFileDataComplete && InBuff.bufferFilled() < InBuff.getMaxBlockSize()){
         if(InBuff.bufferFilled()){
             if(!readID3V1Tag()){
-                int bytesDecoded = sendBytes(InBuff.getReadPtr(), InBuff.bufferFilled());
-                if(bytesDecoded > 2){InBuff.bytesWasRead(bytesDecoded); return;}
+                int bytesDecoded = sendSpan(InBuff.bufferFilled());
+                if(bytesDecoded > 2) return;
             }
         }
         stopSong(); // Correct close when play known length sound #74 and before callback #11
@@ -1197,10 +1561,12 @@ void VS1053::processWebFile(){
             AUDIO_INFO("End of webstream: \"%s\"", m_lastHost);
             if(vs1053_eof_stream) vs1053_eof_stream(m_lastHost);
         }
+        playNextInQueue();
         return;
     }
 
     if(byteCounter == m_contentlength)                    {f_webFileDataComplete = true;}
+    if(chunkedEnd())                                      {f_webFileDataComplete = true;}
     if(byteCounter - m_audioDataStart == m_audioDataSize) {f_webFileDataComplete = true;}
 
     // play audio data - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
@@ -1208,7 +1574,8 @@ void VS1053::processWebFile(){
          if(f_mute) {
             if((muteTime + 200) < millis()) {setVolume(m_vol); f_mute = false;}
         }
-        static uint8_t cnt = 0;
+        if(!bufferReady(true, f_webFileDataComplete)) return;
+        uint8_t& cnt = m_pwf.cnt;
         uint8_t compression;
         if(m_codec == CODEC_WAV)  compression = 1;
         if(m_codec == CODEC_FLAC) compression = 2;
@@ -1219,7 +1586,38 @@ void VS1053::processWebFile(){
     return;
 }
 //---------------------------------------------------------------------------------------------------------------------
+bool VS1053::startTask(uint8_t core, uint8_t prio, uint32_t stackSize){
+    // optional: the state machine runs in its own task, so that slow code in the Arduino loop() can't starve the
+    // VS1053 FIFO. mp3.loop() may still be called, it returns immediately then.
+    if(m_loopTaskHandle) return true;
+    if(!m_mutex) {log_e("oom"); return false;}
+    m_f_loopTaskStop = false;
+    BaseType_t res = xTaskCreatePinnedToCore(loopTask, "vs1053_loop", stackSize, this, prio, &m_loopTaskHandle, core);
+    if(res != pdPASS) {m_loopTaskHandle = NULL; log_e("can't create the loop task"); return false;}
+    AUDIO_INFO("loop task started on core %d, priority %d", core, prio);
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::stopTask(){
+    if(!m_loopTaskHandle) return;
+    m_f_loopTaskStop = true;
+    if(xTaskGetCurrentTaskHandle() == m_loopTaskHandle) return; // called from a callback inside the task, it ends
+                                                                // when loop() returns
+    while(m_loopTaskHandle) vTaskDelay(5);                  // the task deletes itself after the current loop()
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::loopTask(void* param){
+    VS1053* vs = (VS1053*)param;
+    while(!vs->m_f_loopTaskStop){
+        vs->loop();
+        vTaskDelay(1);                                      // the FIFO holds 2048 bytes, 1 tick is short enough
+    }
+    vs->m_loopTaskHandle = NULL;
+    vTaskDelete(NULL);
+}
+//---------------------------------------------------------------------------------------------------------------------
 bool VS1053::pauseResume() {
+    lock_t lck(m_mutex);
     bool retVal = false;
     if(getDatamode() == AUDIO_LOCALFILE || m_streamType == ST_WEBSTREAM) {
         m_f_running = !m_f_running;
@@ -1230,94 +1628,132 @@ bool VS1053::pauseResume() {
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::playAudioData(){
 
+    if(m_f_rebuffering) return;                                  // wait for the reserve, see bufferReady()
     if(InBuff.bufferFilled() < InBuff.getMaxBlockSize()) return; // guard
 
-    int bytesDecoded = sendBytes(InBuff.getReadPtr(), InBuff.getMaxBlockSize());
-
-    if(bytesDecoded < 0) {  // no syncword found or decode error, try next chunk
-        log_i("err bytesDecoded %i", bytesDecoded);
-        uint8_t next = 200;
-        if(InBuff.bufferFilled() < next) next = InBuff.bufferFilled();
-        InBuff.bytesWasRead(next); // try next chunk
-    //    m_bytesNotDecoded += next;
+    sendSpan(InBuff.getMaxBlockSize()); // as much as the VS1053 FIFO accepts now, the rest follows next time
+    return;
+}
+//---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::prebufferBytes(uint16_t ms){
+    // ms of audio in bytes, the bitrate is the one the decoder measures, before that icy-br or the HLS variant,
+    // if nothing is known a typical one for the codec
+    uint32_t br = m_decBitrate;
+    if(!br) br = m_bitrate;
+    if(!br && m_abr.cur >= 0) br = m_abr.bw[m_abr.cur];
+    if(!br && m_codec == CODEC_WAV)  br = 1411200;          // 44.1 kHz, 16 bit, stereo
+    if(!br && m_codec == CODEC_FLAC) br = 900000;
+    if(!br) br = 128000;
+    size_t bytes = (uint64_t)br * ms / 8000;
+    size_t cap = (InBuff.bufferFilled() + InBuff.freeSpace()) * 3 / 4;    // must be reachable with a full buffer
+    return max((size_t)InBuff.getMaxBlockSize() + 1, min(bytes, cap));
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::bufferReady(bool started, bool eof){
+    // prebuffer policy for web streams, true if audio data may go to the decoder
+    // started == false: the first m_prebufMs must be in InBuff, or everything if the file ends earlier
+    // started == true:  an underrun (less than one frame) stops playAudioData() until m_rebufMs are buffered again,
+    //                   the hysteresis avoids feeding the decoder a trickle of bytes that can't be played
+    size_t filled = InBuff.bufferFilled();
+    if(!started) {
+        m_f_rebuffering = false;
+        if(eof) return filled > 0;
+        return filled >= prebufferBytes(m_prebufMs);
+    }
+    if(eof) {m_f_rebuffering = false; return true;}
+    if(millis() - m_decBitrateTime >= 1000) {               // the decoder's average from the first frame on
+        m_decBitrateTime = millis();
+        uint32_t br = getBitRate();
+        if(br) m_decBitrate = br;
+    }
+    if(m_f_rebuffering) {
+        if(filled < prebufferBytes(m_rebufMs)) return false;
+        m_f_rebuffering = false;
+        AUDIO_INFO("rebuffered in %lu ms", (long unsigned)(millis() - m_rebufTime));
+        return true;
     }
-    else {
-        if(bytesDecoded > 0) {InBuff.bytesWasRead(bytesDecoded); return;}
-        if(bytesDecoded == 0) return; // syncword at pos0 found
+    if(m_rebufMs && filled < InBuff.getMaxBlockSize()) {
+        m_f_rebuffering = true;
+        m_rebufTime = millis();
+        AUDIO_INFO("buffer underrun, rebuffering %u ms", m_rebufMs);
+        return false;
     }
-
-    return;
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::setPrebufferTime(uint16_t startMs, uint16_t rebufferMs){
+    // startMs: audio in InBuff before a web stream starts, rebufferMs: before it continues after an underrun
+    // both are limited to 3/4 of InBuff, 0 means one frame (start) or no rebuffering
+    lock_t lck(m_mutex);
+    m_prebufMs = startMs;
+    m_rebufMs  = rebufferMs;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::setPrebufferPreset(uint8_t preset){
+    if(preset == PREBUFFER_RESILIENT) setPrebufferTime(4000, 2000);  // bursty mobile links, needs PSRAM
+    else                              setPrebufferTime( 500,  250);  // PREBUFFER_LOW_LATENCY
 }
 //---------------------------------------------------------------------------------------------------------------------
 bool VS1053::readPlayListData() {
+    // non-blocking like parseHttpResponseHeader(), reads the available bytes line by line and returns, the rest
+    // follows next call. True if the playlist is complete, the lines are in m_playlistContent then
 
     if(getDatamode() != AUDIO_PLAYLISTINIT) return false;
-    if(_client->available() == 0) return false;
-
-    uint32_t chunksize = 0; uint8_t readedBytes = 0;
-    if(m_f_chunked) chunksize = chunkedDataTransfer(&readedBytes);
-    // reads the content of the playlist and stores it in the vector m_contentlength
-    // m_contentlength is a table of pointers to the lines
-    char pl[512] = {0}; // playlistLine
-    uint32_t ctl  = 0;
-    int lines = 0;
-    // delete all memory in m_playlistContent
-    if(!psramFound() && m_playlistFormat == FORMAT_M3U8){log_e("m3u8 playlists requires PSRAM enabled!");}
-    vector_clear_and_shrink(m_playlistContent);
-    while(true){  // outer while
+    if(!m_plTime) {
+        if(rxAvail() == 0) return false;
+        // delete all memory in m_playlistContent
+        if(!psramFound() && m_playlistFormat == FORMAT_M3U8){log_e("m3u8 playlists requires PSRAM enabled!");}
+        vector_clear_and_shrink(m_playlistContent);
+        m_plTime = millis();
+    }
 
-        uint32_t ctime = millis();
-        uint32_t timeout = 2000; // ms
-
-        while(true) { // inner while
-            uint16_t pos = 0;
-            while(_client->available()){ // super inner while :-))
-                pl[pos] = _client->read();
-                ctl++;
-                if(pl[pos] == '\n') {pl[pos] = '\0'; pos++; break;}
-            //    if(pl[pos] == '&' ) {pl[pos] = '\0'; pos++; break;}
-                if(pl[pos] == '\r') {pl[pos] = '\0'; pos++; continue;;}
-                pos++;
-                if(pos == 511){ pos--; continue;}
-                if(pos == 510) {pl[pos] = '\0';}
-                if(ctl == chunksize) {pl[pos] = '\0'; break;}
-                if(ctl == m_contentlength) {pl[pos] = '\0'; break;}
-            }
-            //log_w("pl %s, ctl %i, chunksize %i, m_contentlength %i", pl, ctl, chunksize, m_contentlength);
-            if(ctl == chunksize) break;
-            if(ctl == m_contentlength) break;
-            if(pos) {pl[pos] = '\0'; break;}
-
-            if(ctime + timeout < millis()) {
-                log_e("timeout");
-                for(int i = 0; i<m_playlistContent.size(); i++) log_e("pl%i = %s", i, m_playlistContent[i]);
-                goto exit;}
-        } // inner while
-
-        if(startsWith(pl, "<!DOCTYPE")) {AUDIO_INFO("url is a webpage!"); goto exit;}
-        if(startsWith(pl, "<html"))     {AUDIO_INFO("url is a webpage!"); goto exit;}
-        if(strlen(pl) > 0) m_playlistContent.push_back(strdup((const char*)pl));
-        if(!m_f_psramFound && m_playlistContent.size() == 101){
-            AUDIO_INFO("the number of lines in playlist > 100, for bigger playlist use PSRAM!");
-            break;
+    const uint32_t timeout = 2000; // ms without a byte
+
+    while(true){  // outer while
+        bool eol = false;
+        while(streamAvail()){ // inner while
+            uint8_t c;
+            if(!streamRead(&c, 1)) break;
+            m_plCount++;
+            m_plTime = millis();
+            if(c == '\n') {eol = true; break;}
+            if(c != '\r' && m_rhlPos < sizeof(m_rhl) - 1) m_rhl[m_rhlPos++] = c; // longer lines are cut off
+            if(m_plCount == m_contentlength) {eol = true; break;}
         }
         // termination conditions
         // 1. The http response header returns a value for contentLength -> read chars until contentLength is reached
-        // 2. no contentLength, but Transfer-Encoding:chunked -> compute chunksize and read until chunksize is reached
+        // 2. no contentLength, but Transfer-Encoding:chunked -> read until the last (empty) chunk has been received
         // 3. no chunksize and no contentlengt, but Connection: close -> read all available chars
-        if(ctl == m_contentlength){while(_client->available()) _client->read(); break;} // read '\n\n' if exists
-        if(ctl == chunksize)      {while(_client->available()) _client->read(); break;}
-        if(!_client->connected() && _client->available() == 0) break;
+        bool complete = (m_contentlength && m_plCount == m_contentlength) || chunkedEnd() ||
+                        (!_client->connected() && rxAvail() == 0);
+        if(!eol && !complete) {
+            if(millis() - m_plTime < timeout) return false; // wait for more bytes
+            log_e("timeout");
+            for(int i = 0; i<m_playlistContent.size(); i++) log_e("pl%i = %s", i, m_playlistContent[i]);
+            goto exit;
+        }
+        m_rhl[m_rhlPos] = '\0';
+        m_rhlPos = 0;
 
+        if(startsWith(m_rhl, "<!DOCTYPE")) {AUDIO_INFO("url is a webpage!"); goto exit;}
+        if(startsWith(m_rhl, "<html"))     {AUDIO_INFO("url is a webpage!"); goto exit;}
+        if(strlen(m_rhl) > 0) m_playlistContent.push_back(strdup((const char*)m_rhl));
+        if(!m_f_psramFound && m_playlistContent.size() == 101){
+            AUDIO_INFO("the number of lines in playlist > 100, for bigger playlist use PSRAM!");
+            break;
+        }
+        if(m_contentlength && m_plCount == m_contentlength){while(rxAvail()) rxRead(); break;} // read '\n\n' if exists
+        if(complete) break;
     } // outer while
-    lines = m_playlistContent.size();
-    for (int i = 0; i < lines ; i++) { // print all string in first vector of 'arr'
+    m_plTime = 0;
+    for (int i = 0; i < m_playlistContent.size() ; i++) { // print all string in first vector of 'arr'
         if(m_f_Log) log_i("pl=%i \"%s\"", i, m_playlistContent[i]);
     }
     setDatamode(AUDIO_PLAYLISTDATA);
     return true;
 
     exit:
+        m_plTime = 0;
         vector_clear_and_shrink(m_playlistContent);
         m_f_running = false;
         setDatamode(AUDIO_NONE);
@@ -1460,8 +1896,8 @@ const char* VS1053::parsePlaylist_M3U8() {
     // #EXTINF:10,title="text=\"Spot Block End\" amgTrackId=\"9876543\"",artist=" ",url="length=\"00:00:00\""
     // http://n3fa-e2.revma.ihrhls.com/zc7729/63_sdtszizjcjbz02/main/163374039.aac
 
-    static uint64_t xMedSeq = 0;
-    static boolean f_mediaSeq_found = false;
+    uint64_t& xMedSeq = m_m3u8.xMedSeq;
+    boolean& f_mediaSeq_found = m_m3u8.f_mediaSeq_found;
     boolean f_EXTINF_found = false;
     char llasc[21]; // uint64_t max = 18,446,744,073,709,551,615  thats 20 chars + \0
     if(m_f_firstM3U8call){
@@ -1486,6 +1922,10 @@ const char* VS1053::parsePlaylist_M3U8() {
 
             // "#EXT-X-DISCONTINUITY-SEQUENCE: // not used, 0: seek for continuity numbers, is sometimes not set
             // "#EXT-X-MEDIA-SEQUENCE:"        // not used, is unreliable
+            if (startsWith(m_playlistContent[i], "#EXT-X-TARGETDURATION:")) {
+                m_m3u8_targetDuration = atoi(m_playlistContent[i] + 22); // max segment duration in seconds
+                continue;
+            }
             if (startsWith(m_playlistContent[i], "#EXT-X-VERSION:")) continue;
             if (startsWith(m_playlistContent[i], "#EXT-X-ALLOW-CACHE:")) continue;
             if (startsWith(m_playlistContent[i], "##")) continue;
@@ -1584,7 +2024,7 @@ const char* VS1053::parsePlaylist_M3U8() {
         if(f_EXTINF_found){
             if(f_mediaSeq_found){
                 uint64_t mediaSeq = m3u8_findMediaSeqInURL();
-                if(xMedSeq == 0 || xMedSeq == UINT64_MAX) {log_e("xMediaSequence not found"); connecttohost(m_lastHost);}
+                if(xMedSeq == 0 || xMedSeq == UINT64_MAX) {log_e("xMediaSequence not found"); openHost(m_lastHost, "", "", false);}
                 if(mediaSeq < xMedSeq){
                     uint64_t diff = xMedSeq - mediaSeq;
                     if(diff < 10) {;}
@@ -1603,7 +2043,7 @@ const char* VS1053::parsePlaylist_M3U8() {
                         }
                         else{;}
 
-                        if(m_playlistURL.size() == 0) {connecttohost(m_lastHost);}
+                        if(m_playlistURL.size() == 0) {openHost(m_lastHost, "", "", false);}
                     }
                 }
                 else{
@@ -1626,74 +2066,160 @@ const char* VS1053::m3u8redirection(){
     // #EXT-X-STREAM-INF:BANDWIDTH=37500,AVERAGE-BANDWIDTH=37000,CODECS="mp4a.40.29"
     // 32/playlist.m3u8?hlssid=7562d0e101b84aeea0fa35f8b963a174
 
-    uint32_t bw[20] = {0};
-    uint32_t finalBW = 0;
-    uint16_t choosenLine = 0;
-    uint16_t plcSize = m_playlistContent.size();
-    if(plcSize > 20) plcSize = 20;
-    int16_t posBW = 0;
-
-    for(uint16_t i = 0; i < plcSize; i++){   // looking for best (highest) bandwidth
-        posBW = indexOf(m_playlistContent[i], "BANDWIDTH=");
-        if(posBW > 0){
-            char* endP;
-            bw[i] = strtol(m_playlistContent[i] + posBW + 10, &endP, 10); // read until comma
-        }
-    }
-    for(uint16_t i = 0; i < plcSize; i++){
-        if(bw[i] > finalBW) {finalBW = bw[i], choosenLine = i + 1;}
-    }
-    AUDIO_INFO("bandwidth: %lu bit/s", (long unsigned)finalBW);
-
-    char* tmp = nullptr;
-    if((!endsWith(m_playlistContent[choosenLine], "m3u8") && indexOf(m_playlistContent[choosenLine], "m3u8?") == -1)) {
-        // we have a new m3u8 playlist, skip to next line
-        int pos = indexOf(m_playlistContent[choosenLine - 1], "CODECS=\"mp4a", 18);
+    vector_clear_and_shrink(m_abr.url);
+    m_abr.bw.clear(); m_abr.bw.shrink_to_fit();
+    m_abr.cur = -1;
+
+    for(uint16_t i = 0; i + 1 < m_playlistContent.size(); i++){   // collect all variants
+        const char* inf = m_playlistContent[i];
+        if(!startsWith(inf, "#EXT-X-STREAM-INF:")) continue;
+        int16_t posBW = indexOf(inf, "BANDWIDTH=");
+        while(posBW > 0 && inf[posBW - 1] == '-') posBW = indexOf(inf, "BANDWIDTH=", posBW + 1); // not AVERAGE-BANDWIDTH
+        uint32_t bw = (posBW > 0) ? strtoul(inf + posBW + 10, NULL, 10) : 0; // read until comma
+        int pos = indexOf(inf, "CODECS=", 18);
         // 'mp4a.40.01' AAC Main
         // 'mp4a.40.02' AAC LC (Low Complexity)
         // 'mp4a.40.03' AAC SSR (Scalable Sampling Rate) ??
         // 'mp4a.40.03' AAC LTP (Long Term Prediction) ??
         // 'mp4a.40.03' SBR (Spectral Band Replication)
-        if(pos < 0) {  // not found
-            int pos1 = indexOf(m_playlistContent[choosenLine - 1], "CODECS=", 18);
-            if(pos1 < 0) pos1 = 0;
-            log_e("codec %s in m3u8 playlist not supported", m_playlistContent[choosenLine - 1] + pos1);
-            goto exit;
+        if(pos > 0 && indexOf(inf, "mp4a", pos) < 0) {  // not supported
+            if(m_f_Log) log_i("codec %s in m3u8 playlist not supported", inf + pos);
+            continue;
         }
+        i++;
+        if(startsWith(m_playlistContent[i], "#")) continue;  // no URL follows
+        m_abr.url.push_back(m3u8AbsoluteURL(m_lastHost, m_playlistContent[i]));
+        m_abr.bw.push_back(bw);
     }
-    if(!startsWith(m_playlistContent[choosenLine], "http")) {
-
-        // http://livees.com/prog_index.m3u8 and prog_index48347.aac -->
-        // http://livees.com/prog_index48347.aac http://livees.com/prog_index.m3u8 and chunklist022.m3u8 -->
-        // http://livees.com/chunklist022.m3u8
-
-
-        tmp = (char*)malloc(strlen(m_lastHost) + strlen(m_playlistContent[choosenLine]));
-        strcpy(tmp, m_lastHost);
-        int idx1 = lastIndexOf(tmp, "/");
-        strcpy(tmp + idx1 + 1, m_playlistContent[choosenLine]);
+    if(m_abr.url.empty()) {
+        log_e("no variant with a supported codec in m3u8 playlist");
+        goto exit;
     }
-    else { tmp = strdup(m_playlistContent[choosenLine]); }
 
-    if(m_playlistContent[choosenLine]) {
-        free(m_playlistContent[choosenLine]);
-        m_playlistContent[choosenLine] = NULL;
+    if(m_abrPolicy == ABR_LOWEST)                          m_abr.cur = abrStep(-1, true);
+    else if(m_abrPolicy == ABR_AUTO && m_abr.throughput)   m_abr.cur = abrBest(m_abr.throughput / 100 * m_abrSafety);
+    else {  // ABR_HIGHEST, or ABR_AUTO without a measurement: begin with the best quality
+        m_abr.cur = 0;
+        for(int16_t i = 1; i < m_abr.bw.size(); i++) if(m_abr.bw[i] > m_abr.bw[m_abr.cur]) m_abr.cur = i;
     }
-    m_playlistContent[choosenLine] = strdup(tmp);
+    m_abr.fresh = false;
+    AUDIO_INFO("bandwidth: %lu bit/s, %u variant(s)", (long unsigned)m_abr.bw[m_abr.cur], m_abr.url.size());
+
     if(m_lastM3U8host){free(m_lastM3U8host); m_lastM3U8host = NULL;}
-    m_lastM3U8host = strdup(tmp);
-    if(tmp) {
-        free(tmp);
-        tmp = NULL;
-    }
-    AUDIO_INFO("redirect to %s", m_playlistContent[choosenLine]);
-    _client->stop();
-    return m_playlistContent[choosenLine];  // it's a redirection, a new m3u8 playlist
+    m_lastM3U8host = strdup(m_abr.url[m_abr.cur]);
+    AUDIO_INFO("redirect to %s", m_lastM3U8host);
+    return m_lastM3U8host;  // it's a redirection, a new m3u8 playlist
 exit:
     stopSong();
     return NULL;
 }
 //---------------------------------------------------------------------------------------------------------------------
+char* VS1053::m3u8AbsoluteURL(const char* base, const char* url){
+    // http://livees.com/prog_index.m3u8 and prog_index48347.aac -->
+    // http://livees.com/prog_index48347.aac http://livees.com/prog_index.m3u8 and chunklist022.m3u8 -->
+    // http://livees.com/chunklist022.m3u8
+    if(startsWith(url, "http")) return strdup(url);
+    char* tmp = (char*)malloc(strlen(base) + strlen(url) + 1);
+    strcpy(tmp, base);
+    int idx = lastIndexOf(tmp, "/");
+    strcpy(tmp + idx + 1, url);
+    return tmp;
+}
+//---------------------------------------------------------------------------------------------------------------------
+int16_t VS1053::abrBest(uint32_t budget){ // the variant with the highest bandwidth that fits into budget
+    int16_t best = abrStep(-1, true);     // the lowest, if none fits
+    for(int16_t i = 0; i < m_abr.bw.size(); i++){
+        if(m_abr.bw[i] <= budget && m_abr.bw[i] > m_abr.bw[best]) best = i;
+    }
+    return best;
+}
+//---------------------------------------------------------------------------------------------------------------------
+int16_t VS1053::abrStep(int16_t from, bool up){ // next variant above or below from, -1 if there is none
+    // from == -1 and up == true returns the lowest variant
+    int16_t next = -1;
+    for(int16_t i = 0; i < m_abr.bw.size(); i++){
+        if(i == from) continue;
+        if(from >= 0 && up  && m_abr.bw[i] <= m_abr.bw[from]) continue;
+        if(from >= 0 && !up && m_abr.bw[i] >= m_abr.bw[from]) continue;
+        if(next < 0 || (up ? m_abr.bw[i] < m_abr.bw[next] : m_abr.bw[i] > m_abr.bw[next])) next = i;
+    }
+    return next;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::abrSegmentStart(){ // a segment (or a playlist) is requested now
+    m_abr.tStart = m_abr.tLast = millis();
+    m_abr.blockedMs = 0;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::abrTick(){ // while InBuff is full the download waits for the decoder, not for the network
+    uint32_t now = millis();
+    if(InBuff.freeSpace() < InBuff.getMaxBlockSize()) m_abr.blockedMs += now - m_abr.tLast;
+    m_abr.tLast = now;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::abrSegmentDone(uint32_t bytes){
+    uint32_t dt = millis() - m_abr.tStart;
+    dt = (dt > m_abr.blockedMs) ? dt - m_abr.blockedMs : 0;
+    if(dt < 20) dt = 20;                                    // segment came from a socket buffer, not measurable
+    uint32_t tp = (uint64_t)bytes * 8000 / dt;              // bit/s
+    if(m_abr.throughput) m_abr.throughput = ((uint64_t)m_abr.throughput * 7 + (uint64_t)tp * 3) / 10;
+    else                 m_abr.throughput = tp;
+    m_abr.fresh = true;
+    if(m_f_Log) log_i("segment %lu bytes in %lu ms, throughput %lu bit/s", (long unsigned)bytes,
+                      (long unsigned)dt, (long unsigned)m_abr.throughput);
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::abrSwitch(){
+    // runs before a media playlist reload, that is the segment boundary at which the variant can change
+    // the segments of two variants are only matched via the media sequence number in the URL
+    if(m_abrPolicy != ABR_AUTO || m_abr.url.size() < 2 || m_abr.cur < 0) return false;
+    if(!m_m3u8.f_mediaSeq_found || !m_abr.fresh) return false;
+
+    uint32_t budget = m_abr.throughput / 100 * m_abrSafety;
+    uint32_t curBW  = m_abr.bw[m_abr.cur];
+    if(!curBW) return false;                                        // BANDWIDTH= missing, no play time
+    size_t   filled = InBuff.bufferFilled();
+    size_t   size   = filled + InBuff.freeSpace();
+    uint32_t bufMs  = (uint64_t)filled * 8000 / curBW;              // play time in InBuff at this bitrate
+    uint32_t maxMs  = (uint64_t)size * 8000 / curBW;
+    uint32_t downMs = min((uint32_t)ABR_DOWN_MS, maxMs / 4);        // a small InBuff never holds ABR_UP_MS
+    uint32_t upMs   = min((uint32_t)ABR_UP_MS, maxMs / 2);
+    int16_t  next   = m_abr.cur;
+
+    if(curBW > budget) next = abrBest(budget);                      // the network is too slow for this variant
+    else if(bufMs < downMs) {                                       // the buffer is running dry, one step down
+        int16_t lower = abrStep(m_abr.cur, false);
+        if(lower >= 0) next = lower;
+    }
+    else if(bufMs > upMs) {                                         // enough in reserve, one step up if it fits
+        int16_t higher = abrStep(m_abr.cur, true);
+        if(higher >= 0 && m_abr.bw[higher] <= budget) next = higher;
+    }
+    if(next == m_abr.cur) return false;
+
+    sprintf(m_chbuf, "%lu bit/s -> %lu bit/s, throughput %lu bit/s, buffer %lu ms", (long unsigned)curBW,
+            (long unsigned)m_abr.bw[next], (long unsigned)m_abr.throughput, (long unsigned)bufMs);
+    AUDIO_INFO("HLS variant %s", m_chbuf);
+    if(vs1053_hlsvariant) vs1053_hlsvariant(m_chbuf);
+
+    m_abr.cur = next;
+    m_abr.fresh = false;
+    if(m_lastM3U8host){free(m_lastM3U8host); m_lastM3U8host = NULL;}
+    m_lastM3U8host = strdup(m_abr.url[next]);
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::setHLSBitratePolicy(uint8_t policy, uint8_t safetyPercent){
+    // ABR_HIGHEST and ABR_LOWEST keep the variant, ABR_AUTO follows the measured throughput
+    // safetyPercent: share of the throughput a variant may use, the rest is margin for fluctuations
+    lock_t lck(m_mutex);
+    if(policy > ABR_AUTO) policy = ABR_AUTO;
+    if(safetyPercent < 10)  safetyPercent = 10;
+    if(safetyPercent > 100) safetyPercent = 100;
+    m_abrPolicy = policy;
+    m_abrSafety = safetyPercent;
+}
+//---------------------------------------------------------------------------------------------------------------------
 uint64_t VS1053::m3u8_findMediaSeqInURL(){ // We have no clue what the media sequence is
 
     char* pEnd;
@@ -1880,51 +2406,58 @@ bool VS1053::latinToUTF8(char* buff, size_t bufflen){
     return true;
 }
 
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::readResponseHeaderLine() {
+    // collects the next header line in m_rhl, returns false if it is not complete yet, the rest follows next call
+    // the lines are split in m_rxBuf, body bytes behind the header stay there for streamRead()
+    while(m_rxPos < m_rxLen || rxFill()){
+        const uint8_t* p  = m_rxBuf + m_rxPos;
+        const uint8_t* nl = (const uint8_t*)memchr(p, '\n', m_rxLen - m_rxPos);
+        uint16_t n = nl ? nl - p : m_rxLen - m_rxPos;
+        m_rxPos += n + (nl ? 1 : 0);
+        for(uint16_t i = 0; i < n; i++){
+            if(p[i] < 0x20) continue;                       // '\r'
+            if(m_rhlPos < sizeof(m_rhl) - 1) {m_rhl[m_rhlPos++] = p[i]; continue;}
+            if(m_rhlPos == sizeof(m_rhl) - 1) {             // the rest of the line is cut off
+                m_rhlPos++;
+                if(m_f_Log) log_i("responseHeaderline overflow");
+            }
+        }
+        if(nl) {
+            m_rhlPos = min(m_rhlPos, (uint16_t)(sizeof(m_rhl) - 1));
+            m_rhl[m_rhlPos] = '\0';
+            return true;
+        }
+    }
+    return false;
+}
 //---------------------------------------------------------------------------------------------------------------------
 bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / request
+    // non-blocking, consumes the available bytes line by line and returns, true if the header is complete
 
     if(getDatamode() != HTTP_RESPONSE_HEADER) return false;
-    if(_client->available() == 0)  return false;
+    if(!m_rhTime) {
+        if(rxAvail() == 0)  return false;
+        m_rhTime = millis();
+    }
 
-    char rhl[512]; // responseHeaderline
-    bool ct_seen = false;
-    uint32_t ctime = millis();
-    uint32_t timeout = 2500; // ms
+    const uint32_t timeout = 2500; // ms
 
     while(true){  // outer while
-        uint16_t pos = 0;
-        if((millis() - ctime) > timeout) {
+        if((millis() - m_rhTime) > timeout) {
             log_e("timeout");
             m_f_timeout = true;
             goto exit;
         }
-        while(_client->available()){
-            uint8_t b = _client->read();
-            if(b == '\n') {
-                if(!pos){ // empty line received, is the last line of this responseHeader
-                    if(ct_seen) goto lastToDo;
-                    else
-                        goto exit;
-                }
-                break;
-            }
-            if(b == '\r') rhl[pos] = 0;
-            if(b < 0x20) continue;
-            rhl[pos] = b;
-            pos++;
-            if(pos == 511) {
-                pos = 510;
-                continue;
-            }
-            if(pos == 510) {
-                rhl[pos] = '\0';
-                if(m_f_Log) log_i("responseHeaderline overflow");
-            }
-        } // inner while
-
-        if(!pos) {
-            vTaskDelay(3);
-            continue;
+        if(!readResponseHeaderLine()) return false;         // wait for more bytes
+
+        char* rhl = m_rhl; // responseHeaderline
+        uint16_t pos = m_rhlPos;
+        m_rhlPos = 0;
+        if(!pos){ // empty line received, is the last line of this responseHeader
+            if(m_f_ctseen) goto lastToDo;
+            else
+                goto exit;
         }
 
         if(m_f_Log) {log_i("httpResponseHeader: %s", rhl);}
@@ -1943,6 +2476,7 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
             statusCode[2] = rhl[11];
             statusCode[3] = '\0';
             int sc = atoi(statusCode);
+            if(startsWith(rhl, "HTTP/1.0")) m_f_connClose = true;  // 1.0 closes unless "Connection: keep-alive"
             if(sc > 310){ // e.g. HTTP/1.1 301 Moved Permanently
                 if(vs1053_showstreamtitle) vs1053_showstreamtitle(rhl);
                 goto exit;
@@ -1952,7 +2486,7 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
         else if(startsWith(rhl, "content-type:")){ // content-type: text/html; charset=UTF-8
             int idx = indexOf(rhl + 13, ";");
             if(idx >0) rhl[13 + idx] = '\0';
-            if(parseContentType(rhl + 13)) ct_seen = true;
+            if(parseContentType(rhl + 13)) m_f_ctseen = true;
             else goto exit;
         }
 
@@ -1970,12 +2504,12 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
                                 m_f_m3u8data = true;
                             }
                             httpPrint(c_host);
-                            while(_client->available()) _client->read();  // empty client buffer
+                            while(rxAvail()) rxRead();  // empty client buffer
                             return true;
                         }
                     }
                     AUDIO_INFO("redirect to new host \"%s\"", c_host);
-                    connecttohost(c_host);
+                    openHost(c_host, "", "", false, m_rangeReq);  // a seek or resume keeps its range
                     return true;
                 }
             }
@@ -2013,7 +2547,8 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
         // }
 
         else if(startsWith(rhl, "connection:")) {
-            if(indexOf(rhl, "close", 0) >= 0) {; /* do nothing */}
+            if(indexOf(rhl, "close", 0) >= 0)      m_f_connClose = true;   // not reusable after this response
+            if(indexOf(rhl, "keep-alive", 0) >= 0) m_f_connClose = false;
         }
 
         else if(startsWith(rhl, "icy-genre:")) {
@@ -2053,10 +2588,26 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
             if(m_f_Log) AUDIO_INFO("content-length: %i", m_contentlength);
         }
 
+        else if(startsWith(rhl, "content-range:")) {  // content-range: bytes 1000-9999/10000
+            int idx = indexOf(rhl, "bytes", 14);
+            if(idx > 0) {
+                char* endP;
+                m_webFileOffset = strtoul(rhl + idx + 5, &endP, 10);
+                int slash = indexOf(rhl, "/", idx);
+                if(slash > 0 && rhl[slash + 1] != '*') m_webFileSize = strtoul(rhl + slash + 1, NULL, 10);
+                if(m_f_Log) AUDIO_INFO("content-range: from %lu, file size %lu", (long unsigned)m_webFileOffset,
+                                       (long unsigned)m_webFileSize);
+            }
+        }
+
+        else if(startsWith(rhl, "accept-ranges:")) {
+            if(indexOf(rhl, "bytes", 14) > 0) m_f_acceptRanges = true;
+        }
+
         else if(startsWith(rhl, "icy-description:")) {
             const char* c_idesc = (rhl + 16);
             while(c_idesc[0] == ' ') c_idesc++;
-            latinToUTF8(rhl, sizeof(rhl)); // if already UTF-0 do nothing, otherwise convert to UTF-8
+            latinToUTF8(rhl, sizeof(m_rhl)); // if already UTF-0 do nothing, otherwise convert to UTF-8
             if(vs1053_icydescription) vs1053_icydescription(c_idesc);
         }
 
@@ -2065,6 +2616,7 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
                 m_f_chunked = true;
                 if(!m_f_Log) AUDIO_INFO("chunked data transfer");
                 m_chunkcount = 0;                         // Expect chunkcount in DATA
+                m_chunkState = CHUNK_SIZE;
             }
         }
 
@@ -2092,6 +2644,7 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
         return false;
 
     lastToDo:
+        if(m_f_Log) log_i("response header parsed in %lu ms", (long unsigned)(millis() - m_rhTime));
         if(m_codec != CODEC_NONE){
             setDatamode(AUDIO_DATA); // Expecting data now
             // if(!initializeDecoder()) return false;
@@ -2099,6 +2652,21 @@ bool VS1053::parseHttpResponseHeader() { // this is the response to a GET / requ
             if(m_playlistFormat != FORMAT_M3U8 && vs1053_lasthost) vs1053_lasthost(m_lastHost);
             m_controlCounter = 0;
             m_f_firstCall = true;
+            if(m_streamType == ST_WEBFILE) {
+                if(m_webFileOffset) m_f_acceptRanges = true;           // 206 Partial Content
+                if(!m_webFileSize) m_webFileSize = m_webFileOffset + m_contentlength;
+                if(m_webFileOffset) {                                   // resumed in the middle, no file header
+                    m_controlCounter = 100;
+                    m_audioDataSize = m_contentlength;
+                    m_audioDataStart = 0;
+                    AUDIO_INFO("webfile continues at byte %lu", (long unsigned)m_webFileOffset);
+                }
+                else if(m_rangeReq || m_f_resumed) {
+                    AUDIO_INFO("the server ignores the range, webfile starts at the beginning");
+                    if(m_f_resumed) {InBuff.resetBuffer(); m_f_resumed = false;} // don't append it to the buffered part
+                }
+                if(m_m4a.f_keep) m4aReconnected();                      // moov or mdat of a M4A file
+            }
         }
         else if(m_playlistFormat != FORMAT_NONE){
             setDatamode(AUDIO_PLAYLISTINIT); // playlist expected
@@ -2186,6 +2754,7 @@ bool VS1053::parseContentType(char* ct) {
             break;
         case CT_OGG:
             m_codec = CODEC_OGG;
+            m_f_ogg = true;
             if(m_f_Log) { log_i("ContentType %s found", ct); }
             break;
 
@@ -2219,8 +2788,12 @@ bool VS1053::parseContentType(char* ct) {
 }
 //---------------------------------------------------------------------------------------------------------------------
 uint32_t VS1053::stop_mp3client(){
+    lock_t lck(m_mutex);
+    cancelPendingConnection();
+    clearPlayQueue();
     uint32_t pos = 0;
     if(getDatamode() == AUDIO_LOCALFILE){
+        fileLock_t flck(this);
         pos = getFilePos() - InBuff.bufferFilled();
         audiofile.close();
         setDatamode(AUDIO_NONE);
@@ -2237,23 +2810,53 @@ uint32_t VS1053::stop_mp3client(){
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::setDefaults(){
     // initializationsequence
+    fileLock_t flck(this);                                  // the reader task must not write into InBuff now
     stopSong();
     initInBuff();                                           // initialize InputBuffer if not already done
     InBuff.resetBuffer();
     vector_clear_and_shrink(m_playlistURL);
     vector_clear_and_shrink(m_playlistContent);
     m_hashQueue.clear(); m_hashQueue.shrink_to_fit(); // uint32_t vector
+    cancelPendingConnection();
+    clearConnPool();
     client.stop();
     clientsecure.stop();
+    if(m_heapClient) {m_heapClient->stop(); delete m_heapClient; m_heapClient = NULL;}
+    if(m_connHost)   {free(m_connHost); m_connHost = NULL;}
+    m_f_connClose = false;
+    rxReset();
     _client = static_cast<WiFiClient*>(&client); /* default to *something* so that no NULL deref can happen */
     m_f_timeout = false;
     m_f_ctseen=false;                                       // Contents type not seen yet
     m_metaint=0;                                            // No metaint yet
     m_LFcount=0;                                            // For detection end of header
     m_bitrate=0;                                            // Bitrate still unknown
+    m_decBitrate = 0;
+    m_mp3 = {};
+    if(m_gapless.prevName) free(m_gapless.prevName);
+    m_gapless = {};
+    m_flac = {};
+    m_flacSeek.clear(); m_flacSeek.shrink_to_fit();
+    if(!m_m4a.f_keep) m4aClear();                           // else the M4A parser continues with a range request
+    m_seekSec = 0;
+    m_f_rebuffering = false;
     m_f_firstCall = true;                                   // InitSequence for processWebstream and processLokalFile
     m_f_firstM3U8call = true;                               // InitSequence for parsePlaylist_M3U8
+    m_sdet = {};                                            // streamDetection
+    m_m3u8_targetDuration = 0;
+    m_m3u8SegmentSize = 0;
+    m_audioDataSize = 0;                                    // set again by the file header
+    m_audioDataStart = 0;
+    m_rangeReq = 0;
+    m_f_resumed = false;
+    m_f_resync = false;
+    m_m3u8ReloadTime = millis();
+    vector_clear_and_shrink(m_abr.url);                     // the throughput estimate is kept
+    m_abr.bw.clear(); m_abr.bw.shrink_to_fit();
+    m_abr.cur = -1;
+    m_sdet.tmr_slow = m_sdet.tmr_lost = millis();
     m_controlCounter = 0;
+    m_f_localAudio = false;
     m_f_firstchunk=true;                                    // First chunk expected
     m_f_chunked=false;                                      // Assume not chunked
     m_f_ssl=false;
@@ -2262,6 +2865,7 @@ void VS1053::setDefaults(){
     m_f_webstream = false;
     m_f_tts = false;                                        // text to speech
     m_f_ts = false;
+    m_f_ogg = false;
     m_f_m3u8data = false;                                   // set again in processM3U8entries() if necessary
     setDatamode(AUDIO_NONE);
     m_contentlength = 0;                                    // If Content-Length is known, count it
@@ -2274,6 +2878,7 @@ void VS1053::setDefaults(){
 }
 //---------------------------------------------------------------------------------------------------------------------
 void VS1053::setConnectionTimeout(uint16_t timeout_ms, uint16_t timeout_ms_ssl){
+    lock_t lck(m_mutex);
     if(timeout_ms)     m_timeout_ms     = timeout_ms;
     if(timeout_ms_ssl) m_timeout_ms_ssl = timeout_ms_ssl;
 }
@@ -2282,8 +2887,24 @@ bool VS1053::connecttohost(String host){
     return connecttohost(host.c_str());
 }
 //---------------------------------------------------------------------------------------------------------------------
-bool VS1053::connecttohost(const char* host, const char* user, const char* pwd) {
+bool VS1053::connecttohost(const char* host, const char* user, const char* pwd, uint32_t resumeFilePos) {
     // user and pwd for authentification only, can be empty
+    // resumeFilePos: a webfile starts at this byte if the server supports range requests
+    // a new selection, the play queue is cleared. Playlists, reconnects and the queue itself use openHost().
+    lock_t lck(m_mutex);
+    clearPlayQueue();
+    return openHost(host, user, pwd, false, resumeFilePos);
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::connecttohostAsync(const char* host, const char* user, const char* pwd) {
+    // as connecttohost(), but DNS, TCP and TLS handshake run in the background. The current stream keeps playing
+    // until the new host answers, loop() switches over then. The play queue is cleared as in connecttohost().
+    lock_t lck(m_mutex);
+    clearPlayQueue();
+    return openHost(host, user, pwd, true);
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::openHost(const char* host, const char* user, const char* pwd, bool async, uint32_t rangeStart) {
 
     if(host == NULL) {
         AUDIO_INFO("cth Hostaddress is empty");
@@ -2342,11 +2963,8 @@ bool VS1053::connecttohost(const char* host, const char* user, const char* pwd)
         hostwoext[pos_colon] = '\0';// Host without portnumber
     }
 
-    AUDIO_INFO("Connect to new host: \"%s\"", l_host);
-    setDefaults(); // no need to stop clients if connection is established (default is true)
-
-    if(startsWith(l_host, "https")) m_f_ssl = true;
-    else                            m_f_ssl = false;
+    bool ssl = startsWith(l_host, "https");
+    if(ssl && port == 80) port = 443;
 
     // optional basic authorization
     uint16_t auth = strlen(user) + strlen(pwd);
@@ -2362,7 +2980,8 @@ bool VS1053::connecttohost(const char* host, const char* user, const char* pwd)
 
     //  AUDIO_INFO("Connect to \"%s\" on port %d, extension \"%s\"", hostwoext, port, extension);
 
-    char rqh[strlen(h_host) + strlen(authorization) + 200]; // http request header
+    char rqh[strlen(extension) + strlen(hostwoext) + strlen(authorization) + 150 + 32]; // http request header,
+                                                             // the fixed lines need 150, the Range line 32
     rqh[0] = '\0';
 
     strcat(rqh, "GET ");
@@ -2372,6 +2991,7 @@ bool VS1053::connecttohost(const char* host, const char* user, const char* pwd)
     strcat(rqh, hostwoext);
     strcat(rqh, "\r\n");
     strcat(rqh, "Icy-MetaData:1\r\n");
+    if(rangeStart) sprintf(rqh + strlen(rqh), "Range: bytes=%lu-\r\n", (long unsigned)rangeStart);
 
     if (auth > 0) {
         strcat(rqh, "Authorization: Basic ");
@@ -2388,50 +3008,92 @@ bool VS1053::connecttohost(const char* host, const char* user, const char* pwd)
 //        m_timeout_ms = UINT16_MAX;  // [WiFiClient.cpp:253] connect(): select returned due to timeout 250 ms for fd 48
 //    } fix in V2.0.8
 
-    bool res = true; // no need to reconnect if connection exists
-
-    if(m_f_ssl){ _client = static_cast<WiFiClient*>(&clientsecure); if(port == 80) port = 443;}
-    else       { _client = static_cast<WiFiClient*>(&client);}
+    uint8_t expectedCodec  = CODEC_NONE;
+    uint8_t expectedPlsFmt = FORMAT_NONE;
+    if(endsWith(extension, ".mp3" ))   expectedCodec = CODEC_MP3;
+    if(endsWith(extension, ".aac" ))   expectedCodec = CODEC_AAC;
+    if(endsWith(extension, ".wav" ))   expectedCodec = CODEC_WAV;
+    if(endsWith(extension, ".m4a" ))   expectedCodec = CODEC_M4A;
+    if(endsWith(extension, ".ogg" ))   expectedCodec = CODEC_OGG;
+    if(endsWith(extension, ".flac"))   expectedCodec = CODEC_FLAC;
+    if(endsWith(extension, "-flac"))   expectedCodec = CODEC_FLAC;
+    if(endsWith(extension, ".opus"))   expectedCodec = CODEC_OPUS;
+    if(endsWith(extension, "/opus"))   expectedCodec = CODEC_OPUS;
+    if(endsWith(extension, ".asx" ))  expectedPlsFmt = FORMAT_ASX;
+    if(endsWith(extension, ".m3u" ))  expectedPlsFmt = FORMAT_M3U;
+    if(endsWith(extension, ".pls" ))  expectedPlsFmt = FORMAT_PLS;
+    if(endsWith(extension, ".m3u8"))  expectedPlsFmt = FORMAT_M3U8;
 
-    uint32_t t = millis();
-    if(m_f_Log) AUDIO_INFO("connect to %s on port %d path %s", hostwoext, port, extension);
-    res = _client->connect(hostwoext, port, m_f_ssl ? m_timeout_ms_ssl : m_timeout_ms);
-    if(res){
-        uint32_t dt = millis() - t;
-        strcpy(m_lastHost, l_host);
-        AUDIO_INFO("%s has been established in %u ms, free Heap: %u bytes",
-                    m_f_ssl?"SSL":"Connection", dt, ESP.getFreeHeap());
-        m_f_running = true;
-    }
+    bool res = true; // no need to reconnect if connection exists
 
-    m_expectedCodec = CODEC_NONE;
-    m_expectedPlsFmt = FORMAT_NONE;
-
-    if(res){
-        _client->print(rqh);
-        if(endsWith(extension, ".mp3" ))   m_expectedCodec = CODEC_MP3;
-        if(endsWith(extension, ".aac" ))   m_expectedCodec = CODEC_AAC;
-        if(endsWith(extension, ".wav" ))   m_expectedCodec = CODEC_WAV;
-        if(endsWith(extension, ".m4a" ))   m_expectedCodec = CODEC_M4A;
-        if(endsWith(extension, ".ogg" ))   m_expectedCodec = CODEC_OGG;
-        if(endsWith(extension, ".flac"))   m_expectedCodec = CODEC_FLAC;
-        if(endsWith(extension, "-flac"))   m_expectedCodec = CODEC_FLAC;
-        if(endsWith(extension, ".opus"))   m_expectedCodec = CODEC_OPUS;
-        if(endsWith(extension, "/opus"))   m_expectedCodec = CODEC_OPUS;
-        if(endsWith(extension, ".asx" ))  m_expectedPlsFmt = FORMAT_ASX;
-        if(endsWith(extension, ".m3u" ))  m_expectedPlsFmt = FORMAT_M3U;
-        if(endsWith(extension, ".pls" ))  m_expectedPlsFmt = FORMAT_PLS;
-        if(endsWith(extension, ".m3u8")){ m_expectedPlsFmt = FORMAT_M3U8; if(vs1053_lasthost) vs1053_lasthost(host);}
-        setDatamode(HTTP_RESPONSE_HEADER);   // Handle header
-        m_streamType = ST_WEBSTREAM;
+    if(async){
+        cancelPendingConnection();                          // the last one is not needed anymore
+        pendConn_t* pc     = new pendConn_t();
+        pc->client         = ssl ? new WiFiClientSecure() : new WiFiClient();
+        if(ssl) static_cast<WiFiClientSecure*>(pc->client)->setInsecure();
+        pc->host           = strdup(l_host);
+        pc->hostwoext      = strdup(hostwoext);
+        pc->rqh            = strdup(rqh);
+        pc->port           = port;
+        pc->timeout        = ssl ? m_timeout_ms_ssl : m_timeout_ms;
+        pc->ssl            = ssl;
+        pc->expectedCodec  = expectedCodec;
+        pc->expectedPlsFmt = expectedPlsFmt;
+        pc->t0             = millis();
+        pc->dt             = 0;
+        pc->dns            = 0;
+        pc->resume         = false;
+        pc->state          = PEND_CONNECTING;
+        if(xTaskCreatePinnedToCore(connectTask, "vs1053_connect", 8192, pc, 1, NULL, tskNO_AFFINITY) == pdPASS){
+            m_pendConn = pc;
+            AUDIO_INFO("Connect to new host in background: \"%s\"", l_host);
+        }
+        else{
+            log_e("can't create the connect task");
+            freePendConn(pc);
+            res = false;
+        }
     }
     else{
-        AUDIO_INFO("Request %s failed!", l_host);
-        if(vs1053_showstation) vs1053_showstation("");
-        if(vs1053_showstreamtitle) vs1053_showstreamtitle("");
-        if(vs1053_icydescription) vs1053_icydescription("");
-        if(vs1053_icyurl) vs1053_icyurl("");
-        m_lastHost[0] = 0;
+        AUDIO_INFO("Connect to new host: \"%s\"", l_host);
+        setDefaults(); // no need to stop clients if connection is established (default is true)
+        m_f_ssl = ssl;
+        m_rangeReq = rangeStart;
+
+        if(m_f_ssl){ _client = static_cast<WiFiClient*>(&clientsecure);}
+        else       { _client = static_cast<WiFiClient*>(&client);}
+
+        uint32_t dns = 0, dt = 0;
+        if(m_f_Log) AUDIO_INFO("connect to %s on port %d path %s", hostwoext, port, extension);
+        res = timedConnect(_client, hostwoext, port, m_f_ssl ? m_timeout_ms_ssl : m_timeout_ms, &dns, &dt);
+        if(res){
+            strcpy(m_lastHost, l_host);
+            setConnHost(hostwoext, port, m_f_ssl);
+            AUDIO_INFO("%s has been established in %u ms (DNS %u ms, %s %u ms), free Heap: %u bytes",
+                        m_f_ssl?"SSL":"Connection", dns + dt, dns, m_f_ssl?"TCP+TLS handshake":"TCP", dt,
+                        ESP.getFreeHeap());
+            m_f_running = true;
+        }
+
+        m_expectedCodec = CODEC_NONE;
+        m_expectedPlsFmt = FORMAT_NONE;
+
+        if(res){
+            _client->print(rqh);
+            m_expectedCodec  = expectedCodec;
+            m_expectedPlsFmt = expectedPlsFmt;
+            if(m_expectedPlsFmt == FORMAT_M3U8 && vs1053_lasthost) vs1053_lasthost(host);
+            setDatamode(HTTP_RESPONSE_HEADER);   // Handle header
+            m_streamType = ST_WEBSTREAM;
+        }
+        else{
+            AUDIO_INFO("Request %s failed!", l_host);
+            if(vs1053_showstation) vs1053_showstation("");
+            if(vs1053_showstreamtitle) vs1053_showstreamtitle("");
+            if(vs1053_icydescription) vs1053_icydescription("");
+            if(vs1053_icyurl) vs1053_icyurl("");
+            m_lastHost[0] = 0;
+        }
     }
     if(hostwoext) {free(hostwoext); hostwoext = NULL;}
     if(extension) {free(extension); extension = NULL;}
@@ -2439,7 +3101,301 @@ bool VS1053::connecttohost(const char* host, const char* user, const char* pwd)
     if(h_host   ) {free(h_host);    h_host    = NULL;}
     return res;
 }
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::connectTask(void* param){
+    // runs the blocking connect and sends the request, the result is handed over to loop() through pc->state
+    pendConn_t* pc = (pendConn_t*)param;
+    bool res = timedConnect(pc->client, pc->hostwoext, pc->port, pc->timeout, &pc->dns, &pc->dt);
+    if(res) pc->client->print(pc->rqh);
+    uint8_t expected = PEND_CONNECTING;
+    if(!pc->state.compare_exchange_strong(expected, res ? PEND_CONNECTED : PEND_FAILED)) {
+        freePendConn(pc);                                   // cancelled in the meantime, nobody else owns it
+    }
+    vTaskDelete(NULL);
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::freePendConn(pendConn_t* pc){
+    if(pc->client)    {pc->client->stop(); delete pc->client;}
+    if(pc->host)      free(pc->host);
+    if(pc->hostwoext) free(pc->hostwoext);
+    if(pc->rqh)       free(pc->rqh);
+    if(pc->hdr)       free(pc->hdr);
+    delete pc;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::timedConnect(WiFiClient* c, const char* host, uint16_t port, uint16_t timeout, uint32_t* dnsMs,
+                          uint32_t* connMs){
+    // resolves the name first, so that DNS and TCP/TLS time can be told apart, connect() then finds the address
+    // in the lwIP DNS cache
+    uint32_t t = millis();
+    IPAddress ip;
+    bool res = ip.fromString(host) || WiFi.hostByName(host, ip);
+    *dnsMs = millis() - t;
+    *connMs = 0;
+    if(!res) return false;
+    t = millis();
+    res = c->connect(host, port, timeout);
+    *connMs = millis() - t;
+    return res;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::cancelPendingConnection(){
+    if(!m_pendConn) return;
+    if(m_pendConn->state.exchange(PEND_CANCELLED) != PEND_CONNECTING) freePendConn(m_pendConn);
+    // otherwise connectTask() frees it when connect() returns
+    m_pendConn = NULL;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::processPendingConnection(){
+    pendConn_t* pc = m_pendConn;
+    uint8_t state = pc->state.load();
+    char* location = NULL;
+    if(state == PEND_CONNECTING) return;
+    if(state == PEND_CONNECTED && !pc->resume){             // the old stream is given up for a valid response only
+        int res = pendReadHeader(pc, &location);
+        if(res == 0 && millis() - pc->t0 < pc->timeout + 5000) return; // incomplete, the old stream keeps playing
+        if(res <= 0) state = PEND_FAILED;
+    }
+    else if(state == PEND_CONNECTED && !pc->client->available()){
+        if(millis() - pc->t0 < pc->timeout + 5000) return;  // no response yet, the old stream keeps playing
+        state = PEND_FAILED;
+    }
+    m_pendConn = NULL;
+    if(state == PEND_FAILED){
+        AUDIO_INFO("Request %s failed!", pc->host);
+        freePendConn(pc);
+        return;
+    }
+    if(location){                                           // follow the redirect in the background too
+        if(pc->redirects < 5 && strcmp(location, pc->host)) {
+            AUDIO_INFO("redirect to new host \"%s\"", location);
+            if(openHost(location, "", "", true) && m_pendConn) m_pendConn->redirects = pc->redirects + 1;
+        }
+        else AUDIO_INFO("Request %s failed, too many redirects", pc->host);
+        free(location);
+        freePendConn(pc);
+        return;
+    }
+    if(pc->resume){ // the old connection is dead, InBuff and the decoder keep running
+        if(m_heapClient) {m_heapClient->stop(); delete m_heapClient; m_heapClient = NULL;}
+        else _client->stop();
+        _client = pc->client;
+        m_heapClient = pc->client;
+        m_f_heapClientSsl = pc->ssl;
+        pc->client = NULL;
+        setConnHost(pc->hostwoext, pc->port, pc->ssl);
+        rxReset();                                        // leftovers of the old connection
+        AUDIO_INFO("reconnected in %u ms, %u bytes audio buffered", pc->dns + pc->dt, InBuff.bufferFilled());
+        m_f_resumed = true;
+        m_f_resync = (m_streamType == ST_WEBSTREAM);      // a webfile continues byte exact (Range)
+        m_resyncSkipped = 0;
+        m_metaint = 0;                                    // per-response state as in setDefaults(), the new
+        m_f_metadata = false;                             // response header sets it again
+        m_f_ctseen = false;
+        m_LFcount = 0;
+        m_f_firstchunk = true;
+        m_f_chunked = false;
+        m_contentlength = 0;
+        setDatamode(HTTP_RESPONSE_HEADER);                // chunk decoder, m_webFileOffset, m_webFileSize
+        freePendConn(pc);
+        return;
+    }
+    // the new host answers, switch over now
+    setDefaults();
+    _client = pc->client;
+    m_heapClient = pc->client;
+    m_f_heapClientSsl = pc->ssl;
+    pc->client = NULL;
+    m_f_ssl = pc->ssl;
+    setConnHost(pc->hostwoext, pc->port, pc->ssl);
+    strcpy(m_lastHost, pc->host);
+    AUDIO_INFO("%s has been established in %u ms (DNS %u ms, %s %u ms), free Heap: %u bytes",
+                m_f_ssl?"SSL":"Connection", pc->dns + pc->dt, pc->dns, m_f_ssl?"TCP+TLS handshake":"TCP", pc->dt,
+                ESP.getFreeHeap());
+    m_expectedCodec  = pc->expectedCodec;
+    m_expectedPlsFmt = pc->expectedPlsFmt;
+    if(m_expectedPlsFmt == FORMAT_M3U8 && vs1053_lasthost) vs1053_lasthost(m_lastHost);
+    setDatamode(HTTP_RESPONSE_HEADER);   // Handle header
+    m_streamType = ST_WEBSTREAM;
+    m_f_running = true;
+    memcpy(m_rxBuf, pc->hdr, pc->hdrLen);                   // parseHttpResponseHeader() reads it from there
+    m_rxPos = 0;
+    m_rxLen = pc->hdrLen;
+    freePendConn(pc);
+}
+//---------------------------------------------------------------------------------------------------------------------
+int VS1053::pendReadHeader(pendConn_t* pc, char** location){
+    // collects the response of the new host in pc->hdr, at most sizeof(m_rxBuf) bytes, a longer header is judged
+    // by its status line. Returns 0 if it is incomplete, 1 if the stream can be switched, -1 for an error status
+    // or a missing content-type, 2 for a redirect to *location (malloc'ed)
+    const uint16_t size = sizeof(m_rxBuf);
+    if(!pc->hdr) pc->hdr = (char*)malloc(size + 1);
+    if(!pc->hdr) {log_e("oom"); return -1;}
+    int av = pc->client->available();
+    if(av > 0 && pc->hdrLen < size){
+        int res = pc->client->read((uint8_t*)pc->hdr + pc->hdrLen, min(av, (int)(size - pc->hdrLen)));
+        if(res > 0) pc->hdrLen += res;
+    }
+    pc->hdr[pc->hdrLen] = '\0';
+    char* end = strstr(pc->hdr, "\r\n\r\n");
+    if(!end) end = strstr(pc->hdr, "\n\n");
+    if(!end && pc->hdrLen < size) return 0;
+    if(!end) end = pc->hdr + pc->hdrLen;
+
+    const char* sp = strchr(pc->hdr, ' ');                  // "HTTP/1.1 200 OK" or "ICY 200 OK"
+    int sc = (sp && sp < end) ? atoi(sp + 1) : 0;
+    bool ct = false;
+    for(char* l = pc->hdr; l && l < end; l = strchr(l, '\n'), l = l ? l + 1 : NULL){
+        char name[14];
+        uint8_t i = 0;
+        for(; i < sizeof(name) - 1 && l[i] && l[i] != '\n'; i++) name[i] = toLowerCase(l[i]);
+        name[i] = '\0';
+        if(startsWith(name, "content-type:")) ct = true;
+        if(startsWith(name, "location:") && sc >= 300 && sc < 400 && !*location){
+            const char* v = l + 9;
+            while(*v == ' ') v++;
+            uint16_t n = strcspn(v, "\r\n");
+            *location = (char*)malloc(n + 1);
+            if(*location) {memcpy(*location, v, n); (*location)[n] = '\0';}
+        }
+    }
+    if(*location) return 2;
+    if(sc < 200 || sc >= 300) {
+        uint16_t n = strcspn(pc->hdr, "\r\n");
+        AUDIO_INFO("%s answers \"%.*s\", the current stream keeps playing", pc->host, n, pc->hdr);
+        return -1;
+    }
+    if(end < pc->hdr + pc->hdrLen && !ct) {                 // the whole header is here
+        AUDIO_INFO("%s sends no content-type, the current stream keeps playing", pc->host);
+        return -1;
+    }
+    return 1;
+}
 //------------------------------------------------------------------------------------------------------------------
+bool VS1053::reconnectKeepBuffer(){
+    // opens the stream again in the background without setDefaults(), InBuff keeps playing until the new
+    // connection delivers. A webfile continues with a range request, a webstream is spliced at a frame header.
+    if(m_playlistFormat == FORMAT_M3U8 || m_f_tts || !m_lastHost[0]) return false;
+    uint32_t rangeStart = 0;
+    if(m_streamType == ST_WEBFILE){
+        if(!m_f_acceptRanges) return false;
+        rangeStart = m_webFileOffset + m_pwf.byteCounter;
+    }
+    else if(m_streamType != ST_WEBSTREAM) return false;
+    char* url = strdup(m_lastHost);
+    bool res = openHost(url, "", "", true, rangeStart);
+    free(url);
+    if(!res || !m_pendConn) return false;
+    m_pendConn->resume = true;      // connectTask does not look at it, processPendingConnection() does
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+int VS1053::findFrameSync(const uint8_t* buf, size_t len){
+    // position of the first plausible frame header, -1 if there is none
+    if(m_codec == CODEC_OGG || m_codec == CODEC_VORBIS || (m_codec == CODEC_FLAC && m_f_ogg)) {
+        for(size_t i = 0; i + 4 <= len; i++) if(!memcmp(buf + i, "OggS", 4)) return i;
+        return -1;
+    }
+    if(m_codec == CODEC_FLAC) {                                 // native FLAC, frame sync 0xFFF8 or 0xFFF9
+        for(size_t i = 0; i + 4 <= len; i++) {
+            if(buf[i] != 0xFF || (buf[i + 1] & 0xFE) != 0xF8) continue;
+            if((buf[i + 2] >> 4) == 0 || (buf[i + 2] & 0x0F) == 0x0F) continue;     // reserved block size, invalid rate
+            if((buf[i + 3] >> 4) > 10 || ((buf[i + 3] >> 1) & 0x03) == 0x03 || (buf[i + 3] & 0x01)) continue;
+            return i;
+        }
+        return -1;
+    }
+    if(m_codec != CODEC_MP3 && m_codec != CODEC_AAC) return 0;  // nothing to look for
+    for(size_t i = 0; i + 3 < len; i++){
+        if(buf[i] != 0xFF) continue;
+        if(m_codec == CODEC_MP3){
+            if((buf[i + 1] & 0xE0) != 0xE0) continue;          // 11 sync bits
+            if(((buf[i + 1] >> 3) & 3) == 1) continue;         // version reserved
+            if(((buf[i + 1] >> 1) & 3) == 0) continue;         // layer reserved
+            uint8_t brIdx = buf[i + 2] >> 4;
+            if(brIdx == 0 || brIdx == 0x0F) continue;          // free format or invalid bitrate
+            if(((buf[i + 2] >> 2) & 3) == 3) continue;         // samplerate reserved
+            return i;
+        }
+        else{
+            if((buf[i + 1] & 0xF6) != 0xF0) continue;          // ADTS syncword, layer 0
+            if(((buf[i + 2] >> 2) & 0x0F) > 12) continue;      // sampling frequency index
+            return i;
+        }
+    }
+    return -1;
+}
+//---------------------------------------------------------------------------------------------------------------------
+uint16_t VS1053::mp3FrameLength(const uint8_t* h, uint32_t* sampleRate, uint32_t* bitRate){
+    // length of the MPEG layer III frame with header h, 0 if it isn't one
+    static const uint16_t br1[15] = {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320};  // MPEG1
+    static const uint16_t br2[15] = {0,  8, 16, 24, 32, 40, 48, 56,  64,  80,  96, 112, 128, 144, 160};  // MPEG2, 2.5
+    static const uint16_t sr1[3]  = {44100, 48000, 32000};
+    if(h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return 0;
+    uint8_t version = (h[1] >> 3) & 3;                      // 3: MPEG1, 2: MPEG2, 0: MPEG2.5
+    uint8_t brIdx = h[2] >> 4;
+    uint8_t srIdx = (h[2] >> 2) & 3;
+    if(version == 1 || ((h[1] >> 1) & 3) != 1 || brIdx == 0 || brIdx == 15 || srIdx == 3) return 0;
+    uint32_t br = (version == 3 ? br1[brIdx] : br2[brIdx]) * 1000;
+    uint32_t sr = sr1[srIdx] >> (version == 3 ? 0 : version == 2 ? 1 : 2);
+    if(sampleRate) *sampleRate = sr;
+    if(bitRate) *bitRate = br;
+    return (version == 3 ? 144 : 72) * br / sr + ((h[2] >> 1) & 1);
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::readMP3Info(uint8_t* data, size_t len, uint32_t filePos, uint32_t audioBytes){
+    // data is the start of the audio block at filePos. The first frame may hold a Xing/Info header (LAME) or a
+    // VBRI header (Fraunhofer) with the number of frames and a seek table. Without them the file is taken as CBR.
+    m_mp3 = {};
+    int i = findFrameSync(data, len);
+    if(i < 0) return;
+    uint8_t* h = data + i;
+    size_t avail = len - i;
+    uint32_t sr = 0, br = 0;
+    uint16_t flen = mp3FrameLength(h, &sr, &br);
+    if(!flen) return;
+    if(avail > flen) avail = flen;                          // the headers are inside the first frame
+    bool mpeg1 = ((h[1] >> 3) & 3) == 3;
+    bool mono  = (h[3] >> 6) == 3;
+    m_mp3.firstFrame = filePos + i;
+    m_mp3.bytes = audioBytes > (uint32_t)i ? audioBytes - i : 0;
+    m_mp3.sampleRate = sr;
+    m_mp3.bitRate = br;
+    m_mp3.samplesPerFrame = mpeg1 ? 1152 : 576;
+
+    size_t x = 4 + (mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17)); // behind the side information
+    if(avail >= x + 8 && (!memcmp(h + x, "Xing", 4) || !memcmp(h + x, "Info", 4))) {
+        uint32_t flags = bigEndian(h + x + 4, 4);
+        uint8_t* p = h + x + 8;
+        if((flags & 1) && p + 4 <= h + avail) {m_mp3.frames = bigEndian(p, 4); p += 4;}
+        if((flags & 2) && p + 4 <= h + avail) {uint32_t b = bigEndian(p, 4); if(b) m_mp3.bytes = b; p += 4;}
+        if((flags & 4) && p + 100 <= h + avail) {memcpy(m_mp3.toc, p, 100); m_mp3.f_toc = true;}
+        AUDIO_INFO("%s header, %u frames", !memcmp(h + x, "Xing", 4) ? "Xing" : "Info", m_mp3.frames);
+    }
+    else if(avail >= 36 + 26 && !memcmp(h + 36, "VBRI", 4)) {
+        uint8_t* v = h + 36;
+        uint32_t b = bigEndian(v + 10, 4);
+        if(b) m_mp3.bytes = b;
+        m_mp3.frames = bigEndian(v + 14, 4);
+        uint16_t entries = bigEndian(v + 18, 2);
+        uint16_t scale   = bigEndian(v + 20, 2);
+        uint16_t eSize   = bigEndian(v + 22, 2);
+        uint16_t fpe     = bigEndian(v + 24, 2);            // frames per entry
+        if(entries && fpe && eSize >= 1 && eSize <= 4 && 36 + 26 + (size_t)entries * eSize <= avail && m_mp3.frames && m_mp3.bytes) {
+            // the VBRI table holds the bytes of each fpe frames, it is converted into the percent TOC of Xing
+            uint32_t pos = 0, frame = 0;
+            uint16_t e = 0;
+            for(uint8_t pct = 0; pct < 100; pct++) {
+                uint32_t target = (uint64_t)m_mp3.frames * pct / 100;
+                while(e < entries && frame + fpe <= target) {pos += bigEndian(v + 26 + e * eSize, eSize) * scale; frame += fpe; e++;}
+                m_mp3.toc[pct] = min((uint64_t)255, (uint64_t)pos * 256 / m_mp3.bytes);
+            }
+            m_mp3.f_toc = true;
+        }
+        AUDIO_INFO("VBRI header, %u frames", m_mp3.frames);
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------
 bool VS1053::httpPrint(const char* host) {
     // user and pwd for authentification only, can be empty
 
@@ -2492,7 +3448,8 @@ bool VS1053::httpPrint(const char* host) {
 
     AUDIO_INFO("new request: \"%s\"", host);
 
-    char rqh[strlen(h_host) + 200];  // http request header
+    char rqh[strlen(extension) + strlen(hostwoext) + 150 + 32];  // http request header, the url-encoded extension,
+                                                                // 150 for the fixed lines, 32 for the Range line
     rqh[0] = '\0';
 
     strcat(rqh, "GET ");
@@ -2502,22 +3459,44 @@ bool VS1053::httpPrint(const char* host) {
     strcat(rqh, hostwoext);
     strcat(rqh, "\r\n");
     strcat(rqh, "Accept-Encoding: identity;q=1,*;q=0\r\n");
+    if(m_rangeReq) sprintf(rqh + strlen(rqh), "Range: bytes=%lu-\r\n", (long unsigned)m_rangeReq);
     //    strcat(rqh, "User-Agent: Mozilla/5.0\r\n"); #363
     strcat(rqh, "Connection: keep-alive\r\n\r\n");
 
-    if(m_f_ssl) {
-        _client = static_cast<WiFiClient*>(&clientsecure);
-        if(port == 80) port = 443;
-    }
-    else { _client = static_cast<WiFiClient*>(&client); }
+    if(m_f_ssl && port == 80) port = 443;
 
-    if(!_client->connected()) {
-        AUDIO_INFO("The host has disconnected, reconnecting");
-        if(!_client->connect(hostwoext, port)) {
-            log_e("connection lost");
-            stopSong();
-            return false;
+    bool f_reuse = m_connHost && !strcmp(m_connHost, hostwoext) && m_connPort == port && m_f_connSsl == m_f_ssl &&
+                   !m_f_connClose && _client->connected() && drainBody();
+    if(f_reuse) {
+        if(m_f_Log) log_i("keep-alive connection to %s reused%s", hostwoext, m_f_ssl ? ", no TLS handshake" : "");
+    }
+    else {
+        parkConnection();  // a playlist reload or the next segment may need it again
+        WiFiClient* c = takeConnection(hostwoext, port, m_f_ssl);
+        if(c) {
+            if(m_f_Log) log_i("pooled connection to %s reused%s", hostwoext, m_f_ssl ? ", no TLS handshake" : "");
         }
+        else {
+            AUDIO_INFO("The host has disconnected, reconnecting");
+            c = m_f_ssl ? new WiFiClientSecure() : new WiFiClient();
+            if(m_f_ssl) static_cast<WiFiClientSecure*>(c)->setInsecure();
+            uint32_t dns = 0, dt = 0;
+            if(!timedConnect(c, hostwoext, port, m_f_ssl ? m_timeout_ms_ssl : m_timeout_ms, &dns, &dt)) {
+                delete c;
+                log_e("connection lost");
+                if(hostwoext) {free(hostwoext); hostwoext = NULL;}
+                if(extension) {free(extension); extension = NULL;}
+                if(h_host)    {free(h_host);    h_host    = NULL;}
+                stopSong();
+                return false;
+            }
+            m_heapClient = c;
+            m_f_heapClientSsl = m_f_ssl;
+            if(m_f_Log) AUDIO_INFO("%s has been established in %u ms (DNS %u ms, %s %u ms)", m_f_ssl?"SSL":"Connection",
+                                   dns + dt, dns, m_f_ssl?"TCP+TLS handshake":"TCP", dt);
+        }
+        _client = c;
+        setConnHost(hostwoext, port, m_f_ssl);
     }
     _client->print(rqh);
 
@@ -2551,26 +3530,116 @@ bool VS1053::httpPrint(const char* host) {
     return true;
 }
 //---------------------------------------------------------------------------------------------------------------------
+void VS1053::setConnHost(const char* host, uint16_t port, bool ssl){ // remember where _client is connected to
+    if(m_connHost) {free(m_connHost); m_connHost = NULL;}
+    m_connHost  = strdup(host);
+    m_connPort  = port;
+    m_f_connSsl = ssl;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::bodyComplete(){ // the response body has been read completely, the next request can follow
+    if(m_f_chunked) return m_chunkState == CHUNK_DONE;
+    return m_contentlength > 0 && m_bodyRead >= m_contentlength;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::drainBody(){
+    // reads and discards the rest of the response body if it is already there, false if the connection can't
+    // be used for the next request (body length unknown, too much left or not yet received)
+    if(getDatamode() == HTTP_RESPONSE_HEADER) return false;    // the last response has not even been read
+    uint8_t  buf[256];
+    uint16_t drained = 0;
+    while(!bodyComplete()){
+        if(!rxAvail()) return false;
+        size_t len = m_f_chunked ? sizeof(buf) : min(sizeof(buf), (size_t)(m_contentlength - m_bodyRead));
+        size_t res = streamRead(buf, len);
+        if(!res && !bodyComplete()) return false;
+        drained += res;
+        if(drained > 4096) return false;                    // a new connection is cheaper
+    }
+    if(drained && m_f_Log) log_i("%u bytes of the response body discarded", drained);
+    return rxAvail() == 0;                                  // anything else would be read as the next header
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::parkConnection(){
+    // moves _client into the pool if the server keeps it open, otherwise it is closed
+    bool heap = (_client == m_heapClient);
+    bool keep = m_connHost && !m_f_connClose && _client->connected();
+    if(keep && m_f_connSsl){                                // an idle TLS client holds ~40KB of heap
+        if(!m_f_psramFound || ESP.getFreeHeap() < KA_TLS_HEAP) keep = false;
+    }
+    keep = keep && drainBody();
+    if(keep){
+        uint8_t slot = 0; // a free one or the one idle for the longest time
+        for(uint8_t i = 0; i < KA_POOL_SIZE; i++){
+            if(!m_kaPool[i].client) {slot = i; break;}
+            if(m_kaPool[i].lastUse < m_kaPool[slot].lastUse) slot = i;
+        }
+        if(m_f_connSsl){                                    // at most one TLS client in the pool, it is replaced
+            for(uint8_t i = 0; i < KA_POOL_SIZE; i++) if(m_kaPool[i].client && m_kaPool[i].ssl) {slot = i; break;}
+        }
+        dropPooled(slot);
+        m_kaPool[slot].client  = _client;
+        m_kaPool[slot].host    = strdup(m_connHost);
+        m_kaPool[slot].port    = m_connPort;
+        m_kaPool[slot].ssl     = m_f_connSsl;
+        m_kaPool[slot].heap    = heap;
+        m_kaPool[slot].lastUse = millis();
+    }
+    else{
+        _client->stop();
+        if(heap) delete _client;
+    }
+    rxReset();
+    if(heap) m_heapClient = NULL;
+    if(m_connHost) {free(m_connHost); m_connHost = NULL;}
+    _client = static_cast<WiFiClient*>(&client);            // default to *something*, httpPrint() sets it
+}
+//---------------------------------------------------------------------------------------------------------------------
+WiFiClient* VS1053::takeConnection(const char* host, uint16_t port, bool ssl){
+    // returns a pooled connection to host that is still open, NULL if there is none
+    WiFiClient* c = NULL;
+    for(uint8_t i = 0; i < KA_POOL_SIZE; i++){
+        kaConn_t& kc = m_kaPool[i];
+        if(!kc.client) continue;
+        if(millis() - kc.lastUse > KA_IDLE_MS || !kc.client->connected()) {dropPooled(i); continue;}
+        if(c || kc.port != port || kc.ssl != ssl || strcmp(kc.host, host)) continue;
+        c = kc.client;
+        if(kc.heap) {m_heapClient = c; m_f_heapClientSsl = ssl;}
+        kc.client = NULL;                                   // the pool does not own it anymore
+        free(kc.host); kc.host = NULL;
+    }
+    return c;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::dropPooled(uint8_t slot){
+    kaConn_t& kc = m_kaPool[slot];
+    if(kc.client) {kc.client->stop(); if(kc.heap) delete kc.client; kc.client = NULL;}
+    if(kc.host)   {free(kc.host); kc.host = NULL;}
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::clearConnPool(){
+    for(uint8_t i = 0; i < KA_POOL_SIZE; i++) dropPooled(i);
+}
+//---------------------------------------------------------------------------------------------------------------------
 void VS1053::loadUserCode(void) {
+  lock_t lck(m_mutex);
   int i = 0;
+  uint32_t t = micros();
 
   while (i<sizeof(flac_plugin)/sizeof(flac_plugin[0])) {
-    unsigned short addr, n, val;
+    unsigned short addr, n;
     addr = flac_plugin[i++];
     n = flac_plugin[i++];
     if (n & 0x8000U) { /* RLE run, replicate n samples */
       n &= 0x7FFF;
-      val = flac_plugin[i++];
-      while (n--) {
-        write_register(addr, val);
-      }
+      write_register_run(addr, &flac_plugin[i++], n, true);
     } else {           /* Copy run, copy n samples */
-      while (n--) {
-        val = flac_plugin[i++];
-        write_register(addr, val);
-      }
+      write_register_run(addr, &flac_plugin[i], n, false);
+      i += n;
     }
   }
+  t = micros() - t;
+  AUDIO_INFO("plugin loaded in %lu.%03lu ms", (unsigned long)(t / 1000), (unsigned long)(t % 1000));
 }
 
 //---------------------------------------------------------------------------------------------------------------------
@@ -2616,7 +3685,15 @@ bool VS1053::connecttoSD(const char* sdfile, uint32_t resumeFilePos){
 }
 
 bool VS1053::connecttoFS(fs::FS &fs, const char* path, uint32_t resumeFilePos) {
+    // a new selection, the play queue is cleared, playNextInQueue() uses openFile()
+    lock_t lck(m_mutex);
+    clearPlayQueue();
+    return openFile(fs, path, resumeFilePos);
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::openFile(fs::FS &fs, const char* path, uint32_t resumeFilePos) {
 
+    fileLock_t flck(this);
     if(strlen(path)>255) return false;
     m_resumeFilePos = resumeFilePos;
 
@@ -2653,6 +3730,7 @@ bool VS1053::connecttoFS(fs::FS &fs, const char* path, uint32_t resumeFilePos) {
 
     setDatamode(AUDIO_LOCALFILE);
     m_file_size = audiofile.size();//TEST loop
+    readerWake();                                           // it waits for m_f_localAudio now
 
     char* afn = strdup(audiofile.name());                   // audioFileName
     uint8_t dotPos = lastIndexOf(afn, ".");
@@ -2692,6 +3770,7 @@ bool VS1053::connecttoFS(fs::FS &fs, const char* path, uint32_t resumeFilePos) {
 
     if(endsWith(afn, ".ogg")) {     // FLAC section
         m_codec = CODEC_OGG;
+        m_f_ogg = true;
         m_f_running = true;
         return true;
     } // end FLAC section
@@ -2704,6 +3783,8 @@ bool VS1053::connecttoFS(fs::FS &fs, const char* path, uint32_t resumeFilePos) {
 }
 //---------------------------------------------------------------------------------------------------------------------
 bool VS1053::connecttospeech(const char* speech, const char* lang){
+    lock_t lck(m_mutex);
+    clearPlayQueue();
 
     setDefaults();
     char host[] = "translate.google.com.vn";
@@ -2817,16 +3898,16 @@ void VS1053::unicode2utf8(char* buff, uint32_t len){
 //---------------------------------------------------------------------------------------------------------------------
 int VS1053::read_ID3_Header(uint8_t *data, size_t len) {
 
-    static size_t headerSize;
-    static size_t id3Size;
-    static uint8_t ID3version;
-    static int ehsz = 0;
-    static char frameid[5];
-    static size_t framesize = 0;
-    static bool compressed = false;
-    static bool APIC_seen = false;
-    static size_t APIC_size = 0;
-    static uint32_t APIC_pos = 0;
+    size_t& headerSize = m_id3.headerSize;
+    size_t& id3Size = m_id3.id3Size;
+    uint8_t& ID3version = m_id3.ID3version;
+    int& ehsz = m_id3.ehsz;
+    char (&frameid)[5] = m_id3.frameid;
+    size_t& framesize = m_id3.framesize;
+    bool& compressed = m_id3.compressed;
+    bool& APIC_seen = m_id3.APIC_seen;
+    size_t& APIC_size = m_id3.APIC_size;
+    uint32_t& APIC_pos = m_id3.APIC_pos;
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
     if(m_controlCounter == 0){      /* read ID3 tag and ID3 header size */
         if(getDatamode() == AUDIO_LOCALFILE){
@@ -3065,6 +4146,447 @@ int VS1053::read_ID3_Header(uint8_t *data, size_t len) {
     return 0;
 }
 //---------------------------------------------------------------------------------------------------------------------
+int VS1053::read_FLAC_Header(uint8_t *data, size_t len){
+    // returns the number of bytes to discard, -1 if there is no fLaC signature. STREAMINFO and SEEKTABLE are
+    // read, all other metadata blocks (PICTURE, PADDING, VORBIS_COMMENT...) are skipped, in local files with a
+    // seek. The decoder gets a short header with STREAMINFO only and then the first frame.
+    if(m_controlCounter == 0){
+        if(len < 4) return 0;
+        if(memcmp(data, "fLaC", 4)) return -1;
+        m_flac = {};
+        m_flacSeek.clear();
+        m_flac.pos = 4;
+        m_controlCounter = 1;
+        return 4;
+    }
+    if(m_controlCounter == 1){                              // metadata block header
+        if(len < 4) return 0;
+        m_flac.f_last = data[0] & 0x80;
+        m_flac.blockType = data[0] & 0x7F;
+        m_flac.blockLeft = bigEndian(data + 1, 3);
+        m_flac.pos += 4;
+        m_controlCounter = 2;
+        return 4;
+    }
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    if(m_controlCounter == 2){                              // metadata block data
+        size_t n = 0;
+        if(m_flac.blockType == 0 && m_flac.blockLeft == 34) { // STREAMINFO
+            if(len < 34) return 0;
+            memcpy(m_flac.streamInfo, data, 34);
+            m_flac.sampleRate    = (data[10] << 12) | (data[11] << 4) | (data[12] >> 4);
+            m_flac.channels      = ((data[12] >> 1) & 7) + 1;
+            m_flac.bitsPerSample = (((data[12] & 1) << 4) | (data[13] >> 4)) + 1;
+            m_flac.totalSamples  = ((uint64_t)(data[13] & 0x0F) << 32) | bigEndian(data + 14, 4);
+            AUDIO_INFO("FLAC %u Hz, %u channels, %u bit, %llu samples", m_flac.sampleRate, m_flac.channels,
+                       m_flac.bitsPerSample, (long long unsigned)m_flac.totalSamples);
+            n = 34;
+        }
+        else if(m_flac.blockType == 3 && m_flac.blockLeft >= 18) { // SEEKTABLE, 18 bytes per point
+            n = min((size_t)m_flac.blockLeft, len) / 18 * 18;
+            if(!n) return 0;
+            for(size_t i = 0; i < n; i += 18) {
+                uint64_t sample = ((uint64_t)bigEndian(data + i, 4) << 32) | bigEndian(data + i + 4, 4);
+                if(sample == 0xFFFFFFFFFFFFFFFFULL) continue;   // placeholder
+                m_flacSeek.push_back({sample, (uint32_t)bigEndian(data + i + 12, 4)});
+            }
+        }
+        else if(getDatamode() == AUDIO_LOCALFILE && m_flac.blockLeft > InBuff.bufferFilled()) { // skip it with a seek
+            fileLock_t flck(this);
+            uint32_t filePos = audiofile.position() - InBuff.bufferFilled() + m_flac.blockLeft;
+            if(m_flac.blockType == 6) AUDIO_INFO("FLAC: skip picture, %u bytes", m_flac.blockLeft);
+            InBuff.resetBuffer();
+            m_plf.f_eof = false;
+            audiofile.seek(filePos);
+            m_flac.pos += m_flac.blockLeft;
+            m_flac.blockLeft = 0;
+        }
+        else {
+            n = min((size_t)m_flac.blockLeft, len);
+        }
+        m_flac.pos += n;
+        m_flac.blockLeft -= n;
+        if(m_flac.blockLeft) return n;
+        if(!m_flac.f_last) {m_controlCounter = 1; return n;}
+
+        m_controlCounter = 100;                             // the first frame follows
+        m_flac.audioStart = m_flac.pos;
+        m_audioDataStart = m_flac.pos;
+        m_audioDataSize = getFileSize() > m_flac.pos ? getFileSize() - m_flac.pos : 0;
+        AUDIO_INFO("FLAC metadata %u bytes, %u seek points", m_flac.pos, m_flacSeek.size());
+        if(m_flac.sampleRate) {
+            uint8_t hdr[4 + 4 + 34] = {'f', 'L', 'a', 'C', 0x80, 0, 0, 34}; // last block, STREAMINFO, 34 bytes
+            memcpy(hdr + 8, m_flac.streamInfo, 34);
+            sdi_send_buffer(hdr, sizeof(hdr));
+        }
+        return n;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::flacSeek(uint16_t sec){
+    // the last seek point in front of sec, it is the start of a frame, so the decoder doesn't need to search
+    if(m_flacSeek.empty() || !m_flac.sampleRate) {AUDIO_INFO("FLAC file without SEEKTABLE"); return false;}
+    uint64_t target = (uint64_t)sec * m_flac.sampleRate;
+    size_t i = 0;
+    while(i + 1 < m_flacSeek.size() && m_flacSeek[i + 1].sample <= target) i++;
+    uint32_t pos = m_flac.audioStart + m_flacSeek[i].offset;
+    fileLock_t flck(this);
+    if(!audiofile.seek(pos)) return false;
+    restartDecodeAt(m_flacSeek[i].sample / m_flac.sampleRate, true);
+    AUDIO_INFO("seek to %u s, file position %u", m_seekSec, pos);
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
+int VS1053::read_M4A_Header(uint8_t *data, size_t len){
+    // returns the number of bytes to discard, -1 if the file goes to the decoder as it is. The boxes are read one
+    // after another, the containers on the way to the sample tables are entered, everything else is skipped, in
+    // local files with a seek. If mdat comes first, the parser continues behind it (a seek or a range request).
+    // When moov is read, InBuff continues at the first sample and sendSpan() puts an ADTS header in front of every
+    // sample, so the decoder gets plain AAC and doesn't need moov at the beginning.
+    m4a_t& m = m_m4a;
+    if(m_controlCounter == 0){                              // new file
+        m4aClear();
+        m_controlCounter = 1;
+        return 0;
+    }
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    if(m_controlCounter == 1){                              // box header
+        if(m.f_moov) {m4aStartDemux(); return 0;}           // skipped up to the first sample
+        if(m.moovEnd && m.pos >= m.moovEnd) return m4aMoovDone();
+        if(len < 8) return 0;
+        uint32_t size = bigEndian(data, 4);
+        uint8_t  hdr  = 8;
+        if(size == 1) {                                     // 64 bit size
+            if(len < 16) return 0;
+            if(bigEndian(data + 8, 4)) return m4aError("box > 4GB");
+            size = bigEndian(data + 12, 4);
+            hdr  = 16;
+        }
+        else if(size == 0) size = getFileSize() - m.pos;    // up to the end of the file
+        if(size < hdr) return m4aError("invalid box size");
+        const char* type = (const char*)data + 4;
+
+        if(!memcmp(type, "moov", 4) || !memcmp(type, "trak", 4) || !memcmp(type, "mdia", 4) ||
+           !memcmp(type, "minf", 4) || !memcmp(type, "stbl", 4)) {  // enter the container
+            if(!memcmp(type, "moov", 4)) m.moovEnd = m.pos + size;
+            if(!memcmp(type, "trak", 4)) {if(m.f_sound) m.f_tables = true; m.f_sound = false;}
+            m.pos += hdr;
+            return hdr;
+        }
+        if(!memcmp(type, "mdat", 4) && !m.moovEnd) {        // moov follows behind the audio data
+            if(m.pos + size >= getFileSize()) return m4aError("no moov box");
+            AUDIO_INFO("M4A: moov at the end of the file, continue at %u", m.pos + size);
+            if(getDatamode() == AUDIO_LOCALFILE) {m4aSeekFile(m.pos + size); return 0;}
+            if(!m4aRangeRequest(m.pos + size)) return m4aError("can't read moov");
+            return 0;
+        }
+        bool f_small = !memcmp(type, "mdhd", 4) || !memcmp(type, "hdlr", 4) ||
+                       (m.f_sound && (!memcmp(type, "stsd", 4) || !memcmp(type, "stts", 4)));
+        if(f_small && size <= InBuff.getMaxBlockSize()) {
+            if(len < size) return 0;
+            m4aParseBox(type, data + hdr, size - hdr);
+            m.pos += size;
+            return size;
+        }
+        uint8_t table = 0;
+        if(m.f_sound) {
+            if(!memcmp(type, "stsz", 4)) table = M4A_STSZ;
+            if(!memcmp(type, "stsc", 4)) table = M4A_STSC;
+            if(!memcmp(type, "stco", 4)) table = M4A_STCO;
+            if(!memcmp(type, "co64", 4)) table = M4A_CO64;
+        }
+        uint8_t fix = (table == M4A_STSZ) ? 12 : 8;         // version, flags, (sample size), entry count
+        if(table && size >= hdr + fix) {
+            if(len < (size_t)hdr + fix) return 0;
+            uint8_t* p = data + hdr;
+            uint32_t count = bigEndian(p + fix - 4, 4);
+            m.table = table;
+            m.entrySize = (table == M4A_STSC) ? 12 : (table == M4A_CO64) ? 8 : 4;
+            if(table == M4A_STSZ) {
+                m.sampleSize  = bigEndian(p + 4, 4);
+                m.sampleCount = count;
+                if(m.sampleSize) count = 0;                 // constant size, no table
+            }
+            if(count > 500000 || (uint64_t)count * m.entrySize > size - hdr - fix) return m4aError("invalid sample table");
+            size_t need = count * (table == M4A_STSZ ? sizeof(uint16_t) : table == M4A_STSC ? sizeof(m4aStsc_t) : sizeof(uint32_t));
+            if(need && need + 8192 > heap_caps_get_largest_free_block(MALLOC_CAP_DEFAULT)) { // PSRAM too, if malloc uses it
+                log_e("sample table needs %u bytes", need);
+                return m4aError("not enough memory");
+            }
+            if(table == M4A_STSZ) m_m4aSize.reserve(count);
+            if(table == M4A_STSC) m_m4aStsc.reserve(count);
+            if(table >= M4A_STCO) m_m4aChunk.reserve(count);
+            m.entriesLeft = count;
+            m.boxLeft = size - hdr - fix;
+            m.pos += hdr + fix;
+            m_controlCounter = 2;
+            return hdr + fix;
+        }
+        m.boxLeft = size;                                   // not needed
+        m_controlCounter = 3;
+        return 0;
+    }
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    if(m_controlCounter == 2){                              // table entries
+        uint32_t n = min(m.entriesLeft, (uint32_t)(len / m.entrySize));
+        if(!n && m.entriesLeft) return 0;
+        for(uint32_t i = 0; i < n; i++) {
+            uint8_t* e = data + i * m.entrySize;
+            if(m.table == M4A_STSZ) m_m4aSize.push_back(min((uint32_t)bigEndian(e, 4), (uint32_t)UINT16_MAX));
+            if(m.table == M4A_STSC) m_m4aStsc.push_back({(uint32_t)bigEndian(e, 4), (uint32_t)bigEndian(e + 4, 4)});
+            if(m.table == M4A_STCO) m_m4aChunk.push_back(bigEndian(e, 4));
+            if(m.table == M4A_CO64) m_m4aChunk.push_back(bigEndian(e + 4, 4)); // files < 4GB
+        }
+        m.entriesLeft -= n;
+        m.boxLeft -= n * m.entrySize;
+        m.pos += n * m.entrySize;
+        if(!m.entriesLeft) m_controlCounter = 3;            // the rest of the box, usually nothing
+        return n * m.entrySize;
+    }
+    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+    if(m_controlCounter == 3){                              // skip m.boxLeft bytes
+        if(getDatamode() == AUDIO_LOCALFILE && m.boxLeft > InBuff.bufferFilled()) {
+            m_controlCounter = 1;
+            m4aSeekFile(m.pos + m.boxLeft);
+            return 0;
+        }
+        uint32_t n = min(m.boxLeft, (uint32_t)len);
+        m.boxLeft -= n;
+        m.pos += n;
+        if(!m.boxLeft) m_controlCounter = 1;
+        return n;
+    }
+    return 0;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aParseBox(const char* type, uint8_t* p, uint32_t len){
+    m4a_t& m = m_m4a;
+    if(!memcmp(type, "mdhd", 4)) {
+        if(p[0] == 1 && len >= 32) {m.tsTrak = bigEndian(p + 20, 4); m.durTrak = bigEndian(p + 28, 4);} // 64 bit times
+        else if(len >= 20)         {m.tsTrak = bigEndian(p + 12, 4); m.durTrak = bigEndian(p + 16, 4);}
+    }
+    if(!memcmp(type, "hdlr", 4) && len >= 12 && !memcmp(p + 8, "soun", 4) && !m.f_tables) {
+        m.f_sound = true;
+        m.timescale = m.tsTrak;
+        m.duration  = m.durTrak;
+    }
+    if(!memcmp(type, "stts", 4) && len >= 16 && bigEndian(p + 4, 4)) m.delta = bigEndian(p + 12, 4);
+    if(!memcmp(type, "stsd", 4) && len >= 8 + 36) {
+        uint8_t* e   = p + 8;                               // first sample entry
+        uint8_t* end = e + min((uint32_t)bigEndian(e, 4), len - 8);
+        if(memcmp(e + 4, "mp4a", 4)) {AUDIO_INFO("M4A: %.4s is not supported", e + 4); return;}
+        uint16_t ver = bigEndian(e + 16, 2);                // QuickTime sound sample description version
+        uint8_t* b = e + 36 + (ver == 1 ? 16 : ver == 2 ? 36 : 0);
+        while(b + 8 <= end && memcmp(b + 4, "esds", 4)) {   // child boxes, look for esds
+            uint32_t sz = bigEndian(b, 4);
+            if(sz < 8) return;
+            b += sz;
+        }
+        if(b + 12 > end) return;
+        uint8_t* q = b + 12;                                // behind size, type, version and flags
+        uint8_t* qEnd = min(end, b + bigEndian(b, 4));
+        while(q + 2 <= qEnd) {                              // ES_Descriptor > DecoderConfigDescriptor > DecSpecificInfo
+            uint8_t tag = *q++;
+            uint32_t dl = 0;
+            for(uint8_t i = 0; i < 4 && q < qEnd; i++) {uint8_t c = *q++; dl = (dl << 7) | (c & 0x7F); if(!(c & 0x80)) break;}
+            if(tag == 0x03) {
+                if(q + 3 > qEnd) return;
+                uint8_t flags = q[2];
+                q += 3;
+                if(flags & 0x80) q += 2;                    // dependsOn_ES_ID
+                if(flags & 0x40) {if(q >= qEnd) return; q += 1 + *q;} // URL
+                if(flags & 0x20) q += 2;                    // OCR_ES_Id
+            }
+            else if(tag == 0x04) {
+                if(q + 13 > qEnd) return;
+                if(q[0] == 0x6B || q[0] == 0x69) {AUDIO_INFO("M4A: mp3 in mp4 is not supported"); return;}
+                q += 13;
+            }
+            else if(tag == 0x05) {
+                if(dl < 2 || q + 2 > qEnd) return;
+                m.objType = q[0] >> 3;
+                m.freqIdx = ((q[0] & 7) << 1) | (q[1] >> 7);
+                m.chanCfg = (q[1] >> 3) & 0x0F;
+                m.f_asc = (m.objType != 31 && m.freqIdx < 13);
+                return;
+            }
+            else q += dl;
+        }
+    }
+}
+//---------------------------------------------------------------------------------------------------------------------
+int VS1053::m4aMoovDone(){
+    m4a_t& m = m_m4a;
+    if(m.f_sound) m.f_tables = true;
+    if(!m.f_tables || !m.f_asc)                           return m4aError("no AAC track");
+    if(m_m4aChunk.empty() || m_m4aStsc.empty() || !m.sampleCount || !m.timescale) return m4aError("sample tables missing");
+    if(!m.sampleSize && m_m4aSize.size() != m.sampleCount) return m4aError("stsz incomplete");
+    if(m_m4aStsc[0].firstChunk != 1)                      return m4aError("invalid stsc");
+    for(size_t i = 0; i < m_m4aStsc.size(); i++) if(!m_m4aStsc[i].spc) return m4aError("invalid stsc");
+    m.f_moov = true;
+    uint32_t first = m_m4aChunk[0];
+    if(m.pos == first) {m4aStartDemux(); return 0;}
+    if(getDatamode() == AUDIO_LOCALFILE) {m4aSeekFile(first); m4aStartDemux(); return 0;}
+    if(m.pos < first) {m.boxLeft = first - m.pos; m_controlCounter = 3; return 0;} // skip up to the first sample
+    if(!m4aRangeRequest(first)) return m4aError("can't read mdat");
+    return 0;
+}
+//---------------------------------------------------------------------------------------------------------------------
+int VS1053::m4aError(const char* msg){
+    AUDIO_INFO("M4A: %s", msg);
+    if(m_m4a.pos && getDatamode() == AUDIO_LOCALFILE) m4aSeekFile(0); // the decoder gets the file as it is
+    else if(m_m4a.pos) {m4aClear(); stopSong(); return 0;}             // the beginning of the webfile is gone
+    m4aClear();
+    return -1;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aSeekFile(uint32_t pos){
+    fileLock_t flck(this);
+    InBuff.resetBuffer();
+    m_plf.f_eof = false;
+    audiofile.seek(pos);
+    m_m4a.pos = pos;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::m4aRangeRequest(uint32_t pos){
+    // webfile: a new request from pos on, m_m4a survives setDefaults(), see m4aReconnected()
+    char* url = strdup(m_lastHost);
+    m_m4a.f_keep = true;
+    bool res = openHost(url, "", "", false, pos);
+    free(url);
+    if(!res) m_m4a.f_keep = false;
+    return res;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aReconnected(){
+    // response to m4aRangeRequest(), the parser or the demultiplexer continues at m_webFileOffset
+    m_m4a.f_keep = false;
+    if(!m_webFileOffset) {AUDIO_INFO("M4A: the server ignores the range request"); m4aClear(); stopSong(); return;}
+    m_m4a.pos = m_webFileOffset;
+    if(m_m4a.f_moov) m4aStartDemux();
+    else m_controlCounter = 1;
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aClear(){
+    m_m4a = {};
+    m_m4aSize.clear();  m_m4aSize.shrink_to_fit();
+    m_m4aChunk.clear(); m_m4aChunk.shrink_to_fit();
+    m_m4aStsc.clear();  m_m4aStsc.shrink_to_fit();
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aStartDemux(){
+    m4a_t& m = m_m4a;
+    m4aFirstSample();
+    while(m.sample < m.sampleCount) m4aNextSample();        // end of the last sample, the rest isn't read
+    uint32_t last = m.offset;
+    m4aFirstSample();
+    uint32_t base = (getDatamode() == AUDIO_LOCALFILE) ? 0 : m_webFileOffset;
+    m_audioDataStart = m.offset - base;                     // webfiles count from the start of the response
+    m_audioDataSize  = last > m.offset ? last - m.offset : 0;
+    if(getDatamode() == AUDIO_LOCALFILE) m_contentlength = last;
+    m.streamPos  = m.pos;
+    m.sampleLeft = 0;
+    m.f_demux    = true;
+    m_controlCounter = 100;
+    AUDIO_INFO("M4A: %u samples, %u s, audio data at %u", m.sampleCount, m.duration / m.timescale, m.offset);
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aFirstSample(){
+    m4a_t& m = m_m4a;
+    m.sample  = 0;
+    m.chunk   = 0;
+    m.stscIdx = 0;
+    m.inChunk = m_m4aStsc[0].spc;
+    m.offset  = m_m4aChunk[0];
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::m4aNextSample(){
+    // samples of a chunk are contiguous, the chunks can be anywhere (stco), stsc gives the samples per chunk
+    m4a_t& m = m_m4a;
+    m.offset += m4aSampleSize(m.sample);
+    m.sample++;
+    if(--m.inChunk) return;
+    m.chunk++;
+    if(m.chunk >= m_m4aChunk.size()) {m.sample = m.sampleCount; return;}
+    m.offset = m_m4aChunk[m.chunk];
+    if(m.stscIdx + 1 < m_m4aStsc.size() && m_m4aStsc[m.stscIdx + 1].firstChunk <= m.chunk + 1) m.stscIdx++;
+    m.inChunk = m_m4aStsc[m.stscIdx].spc;
+}
+//---------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::m4aSampleSize(uint32_t i){
+    if(m_m4a.sampleSize) return m_m4a.sampleSize;
+    return i < m_m4aSize.size() ? m_m4aSize[i] : 0;
+}
+//---------------------------------------------------------------------------------------------------------------------
+size_t VS1053::m4aSendSpan(size_t maxLen){
+    // sendSpan() for M4A: InBuff holds the file from the first sample on, every sample gets an ADTS header,
+    // bytes between the samples (other tracks, boxes behind mdat) are discarded. Returns the bytes taken from InBuff.
+    m4a_t& m = m_m4a;
+    size_t done = 0;
+    while(done < maxLen) {
+        if(!m.sampleLeft) {
+            if(m.sample >= m.sampleCount) {                 // all samples sent
+                size_t n = min(maxLen - done, InBuff.bufferFilled());
+                InBuff.bytesWasRead(n);
+                done += n;
+                break;
+            }
+            if(m.offset > m.streamPos) {                    // gap up to the next sample
+                size_t n = min(min(maxLen - done, InBuff.bufferFilled()), (size_t)(m.offset - m.streamPos));
+                if(!n) break;
+                InBuff.bytesWasRead(n);
+                m.streamPos += n;
+                done += n;
+                continue;
+            }
+            if(!InBuff.bufferFilled() || !DREQ()) break;
+            uint32_t frameLen = m4aSampleSize(m.sample) + 7;
+            uint8_t profile = (m.objType >= 1 && m.objType <= 4) ? m.objType - 1 : 1; // SBR/PS: AAC LC core
+            uint8_t hdr[7];
+            hdr[0] = 0xFF;
+            hdr[1] = 0xF1;                                  // MPEG-4, no CRC
+            hdr[2] = (profile << 6) | (m.freqIdx << 2) | (m.chanCfg >> 2);
+            hdr[3] = ((m.chanCfg & 3) << 6) | ((frameLen >> 11) & 3);
+            hdr[4] = (frameLen >> 3) & 0xFF;
+            hdr[5] = ((frameLen & 7) << 5) | 0x1F;
+            hdr[6] = 0xFC;
+            sendBytes(hdr, 7);                              // DREQ high: 32 bytes fit at least
+            m.sampleLeft = frameLen - 7;
+            if(!m.sampleLeft) {m4aNextSample(); continue;}
+        }
+        AudioBuffer::span_t sp = InBuff.getReadSpan(min(maxLen - done, (size_t)m.sampleLeft));
+        if(!sp.len1) break;
+        size_t n = sendBytes(sp.ptr1, sp.len1);
+        if(n == sp.len1 && sp.len2) n += sendBytes(sp.ptr2, sp.len2);
+        if(!n) break;                                       // FIFO full
+        InBuff.bytesWasRead(n);
+        m.sampleLeft -= n;
+        m.streamPos  += n;
+        done += n;
+        if(!m.sampleLeft) m4aNextSample();
+    }
+    return done;
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::m4aSeek(uint16_t sec){
+    // local M4A: the sample at sec from the sample tables, every sample is a frame start
+    m4a_t& m = m_m4a;
+    if(!m.f_demux) return false;
+    uint32_t delta = m.delta ? m.delta : 1024;              // AAC: 1024 samples per frame
+    uint32_t target = (uint64_t)sec * m.timescale / delta;
+    if(target >= m.sampleCount) return false;
+    fileLock_t flck(this);
+    m4aFirstSample();
+    while(m.sample < target) m4aNextSample();
+    if(!audiofile.seek(m.offset)) return false;
+    m.streamPos  = m.offset;
+    m.sampleLeft = 0;
+    restartDecodeAt((uint64_t)target * delta / m.timescale, true);
+    AUDIO_INFO("seek to %u s, file position %u", m_seekSec, m.offset);
+    return true;
+}
+//---------------------------------------------------------------------------------------------------------------------
 void VS1053::showID3Tag(const char* tag, const char* value){
 
     m_chbuf[0] = 0;
@@ -3168,22 +4690,117 @@ void VS1053::showID3Tag(const char* tag, const char* value){
 }
 //---------------------------------------------------------------------------------------------------------------------
 uint32_t VS1053::getFileSize(){
+    if(m_streamType == ST_WEBFILE && m_f_running) return m_webFileSize;
     if (!audiofile) return 0;
     return audiofile.size();
 }
 //---------------------------------------------------------------------------------------------------------------------
 uint32_t VS1053::getFilePos(){
+    if(m_streamType == ST_WEBFILE && m_f_running) { // the played position, can be given to connecttohost() to resume
+        uint32_t pos = m_webFileOffset + m_pwf.byteCounter;
+        uint32_t filled = InBuff.bufferFilled();
+        return pos > filled ? pos - filled : 0;
+    }
     if (!audiofile) return 0;
     return audiofile.position();
 }
 //---------------------------------------------------------------------------------------------------------------------
 bool VS1053::setFilePos(uint32_t pos){
+    lock_t lck(m_mutex);
+    if(m_streamType == ST_WEBFILE && m_f_running && !m_f_tts) { // a new request that starts at pos
+        if(!m_f_acceptRanges) {AUDIO_INFO("the server does not support range requests"); return false;}
+        if(m_webFileSize && pos >= m_webFileSize) return false;
+        if(m_codec != CODEC_MP3 && m_codec != CODEC_AAC && pos) {log_e("seek in %s webfiles not supported", getCodecname()); return false;}
+        char* url = strdup(m_lastHost);
+        bool res = openHost(url, "", "", false, pos);
+        free(url);
+        return res;
+    }
+    fileLock_t flck(this);
     if (!audiofile) return false;
-    return audiofile.seek(pos);
+    m_plf.f_eof = false;
+    bool res = audiofile.seek(pos);
+    readerWake();
+    return res;
+}
+//---------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::getAudioFileDuration(){
+    if(getDatamode() != AUDIO_LOCALFILE) return 0;
+    if(m_codec == CODEC_FLAC) return m_flac.sampleRate ? m_flac.totalSamples / m_flac.sampleRate : 0;
+    if(m_codec == CODEC_M4A)  return m_m4a.f_demux ? m_m4a.duration / m_m4a.timescale : 0;
+    if(m_codec != CODEC_MP3 || !m_mp3.sampleRate) return 0;
+    if(m_mp3.frames) return (uint64_t)m_mp3.frames * m_mp3.samplesPerFrame / m_mp3.sampleRate;
+    return (uint64_t)m_mp3.bytes * 8 / m_mp3.bitRate;       // CBR
+}
+//---------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::getAudioCurrentTime(){
+    // the decoder counts the played seconds, gaplessAdvance() starts it again with the next track
+    lock_t lck(m_mutex);
+    return m_seekSec + read_register(SCI_DECODE_TIME);
+}
+//---------------------------------------------------------------------------------------------------------------------
+void VS1053::restartDecodeAt(uint16_t sec, bool flush){
+    // the played time counts from sec again. flush: after a seek, the data in InBuff is from the old position,
+    // the caller holds fileLock_t. The reader task continues at the file position.
+    if(flush) {
+        InBuff.resetBuffer();
+        m_plf.f_eof = false;
+    }
+    m_seekSec = sec;
+    write_register(SCI_DECODE_TIME, 0);                     // twice, the decoder may overwrite the first one
+    write_register(SCI_DECODE_TIME, 0);
+    readerWake();
+}
+//---------------------------------------------------------------------------------------------------------------------
+bool VS1053::setAudioPlayPosition(uint16_t sec){
+    // the position is taken from the Xing/VBRI TOC (VBR) or computed from the bitrate (CBR), then the next
+    // frame header is searched. The candidate counts if another header follows one frame length later.
+    lock_t lck(m_mutex);
+    uint32_t dur = getAudioFileDuration();
+    if(!dur || !audiofile || m_controlCounter != 100) return false;
+    if(sec >= dur) return false;
+    if(m_gapless.prevName) return false;                    // the file is the next track already, not the playing one
+    if(m_codec == CODEC_FLAC) return flacSeek(sec);
+    if(m_codec == CODEC_M4A)  return m4aSeek(sec);
+    uint32_t offs;
+    if(m_mp3.f_toc) {
+        float pct = (float)sec * 100 / dur;
+        uint8_t i = min((int)pct, 99);
+        float fa = m_mp3.toc[i];
+        float fb = i < 99 ? m_mp3.toc[i + 1] : 256;
+        offs = (fa + (fb - fa) * (pct - i)) / 256 * m_mp3.bytes;
+    }
+    else offs = (uint64_t)m_mp3.bytes * sec / dur;
+    uint32_t pos = m_mp3.firstFrame + offs;
+
+    const size_t win = 4096;                                // two frames of 1441 bytes at most, some garbage
+    uint8_t* buf = (uint8_t*)__malloc_heap_psram(win);
+    if(!buf) {log_e("out of memory"); return false;}
+    fileLock_t flck(this);
+    int32_t n = audiofile.seek(pos) ? audiofile.read(buf, win) : -1;
+    if(n <= 0) {free(buf); return false;}
+    int sync = -1;
+    for(int i = 0; i + 4 <= n; i++) {
+        int j = findFrameSync(buf + i, n - i);
+        if(j < 0) break;
+        i += j;
+        uint16_t flen = mp3FrameLength(buf + i);
+        if(!flen || i + flen + 4 > n) continue;
+        if(buf[i + flen + 1] != buf[i + 1] || ((buf[i + flen + 2] ^ buf[i + 2]) & 0x0C)) continue; // same stream
+        if(!mp3FrameLength(buf + i + flen)) continue;
+        sync = i;
+        break;
+    }
+    free(buf);
+    if(sync < 0) sync = 0;                                  // the decoder has to find it
+    if(!audiofile.seek(pos + sync)) return false;
+    restartDecodeAt(sec, true);
+    AUDIO_INFO("seek to %u s, file position %u", sec, pos + sync);
+    return true;
 }
 //---------------------------------------------------------------------------------------------------------------------
 uint32_t VS1053::getAudioDataStartPos() {
-    if(!audiofile) return 0;
+    if(!audiofile && !(m_streamType == ST_WEBFILE && m_f_running)) return 0;
     return m_audioDataStart;
 }
 //---------------------------------------------------------------------------------------------------------------------
@@ -3238,14 +4855,9 @@ bool VS1053::ts_parsePacket(uint8_t* packet, uint8_t* packetStart, uint8_t* pack
 
     (void) PAYLOAD_SIZE;  // suppress [-Wunused-variable]
 
-    typedef struct{
-        int number= 0;
-        int pids[PID_ARRAY_LEN];
-    } pid_array;
-
-    static pid_array pidsOfPMT;
-    static int PES_DataLength = 0;
-    static int pidOfAAC = 0;
+    pid_array_t& pidsOfPMT = m_tspp.pidsOfPMT;
+    int& PES_DataLength = m_tspp.PES_DataLength;
+    int& pidOfAAC = m_tspp.pidOfAAC;
 
     if(packet == NULL){
         if(m_f_Log) log_i("parseTS reset");
@@ -3323,7 +4935,7 @@ bool VS1053::ts_parsePacket(uint8_t* packet, uint8_t* packetStart, uint8_t* pack
 
     }
     else if(PID == pidOfAAC) {
-        static uint8_t fillData = 0;
+        uint8_t& fillData = m_tspp.fillData;
         if(m_f_Log) log_i("AAC");
         uint8_t posOfPacketStart = 4;
         if(AFL >= 0) {posOfPacketStart = 5 + AFL;
@@ -3415,40 +5027,27 @@ bool VS1053::ts_parsePacket(uint8_t* packet, uint8_t* packetStart, uint8_t* pack
 //----------------------------------------------------------------------------------------------------------------------
 //    W E B S T R E A M  -  H E L P   F U N C T I O N S
 //----------------------------------------------------------------------------------------------------------------------
-uint16_t VS1053::readMetadata(uint16_t maxBytes, bool first) {
-
-    static uint16_t pos_ml = 0;                          // determines the current position in metaline
-    static uint16_t metalen = 0;
-    uint16_t res = 0;
-    // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-    if(first){
-        pos_ml = 0;
-        metalen = 0;
-        return 0;
-    }
+size_t VS1053::readMetadata(const uint8_t* data, size_t len) {
+    // consumes the metadata block at data (length byte and metaline), it may come in pieces over several calls
+    // returns the number of bytes used, m_metacount starts again when the block is complete
+    uint16_t& pos_ml = m_rmet.pos_ml;                           // determines the current position in metaline
+    uint16_t& metalen = m_rmet.metalen;
+    size_t res = 0;
     // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-    if(!maxBytes) return 0;  // guard
+    if(!len) return 0;  // guard
 
     if(!metalen) {
-        int b = _client->read();   // First byte of metadata?
-        metalen = b * 16 ;                              // New count for metadata including length byte, max 4096
+        metalen = data[0] * 16 ;                        // New count for metadata including length byte, max 4096
         pos_ml = 0; m_chbuf[pos_ml] = 0;                // Prepare for new line
         res = 1;
-    }
-    if(!metalen) {m_metacount = m_metaint; return res;} // metalen is 0
-    if(metalen < m_chbufSize){
-        uint16_t a = _client->readBytes(&m_chbuf[pos_ml], min((uint16_t)(metalen - pos_ml), (uint16_t)(maxBytes -1)));
-        res += a;
-        pos_ml += a;
-    }
-    else{ // metadata doesn't fit in m_chbuf
-        uint8_t c = 0;
-        int8_t i = 0;
-        while(pos_ml != metalen){
-            i = _client->read(&c, 1); // fake read
-            if(i != -1) {pos_ml++; res++;}
-            else {return res;}
-        }
+        if(!metalen) {m_metacount = m_metaint; return res;} // metalen is 0
+    }
+    uint16_t a = min(len - res, (size_t)(metalen - pos_ml));
+    if(metalen < m_chbufSize) memcpy(&m_chbuf[pos_ml], data + res, a); // bigger metadata is skipped in one step
+    res += a;
+    pos_ml += a;
+    if(pos_ml == metalen && metalen >= m_chbufSize) {
+        if(m_f_Log) log_i("metadata of %u bytes doesn't fit in m_chbuf, skipped", metalen);
         m_metacount = m_metaint;
         metalen = 0;
         pos_ml = 0;
@@ -3476,31 +5075,111 @@ uint16_t VS1053::readMetadata(uint16_t maxBytes, bool first) {
     return res;
 }
 //----------------------------------------------------------------------------------------------------------------------
-size_t VS1053::chunkedDataTransfer(uint8_t* bytes){
-    uint8_t byteCounter = 0;
-    size_t chunksize = 0;
-    int b = 0;
-    uint32_t ctime = millis();
-    uint32_t timeout = 2000; // ms
-    while(true){
-        if(ctime + timeout < millis()) {
-            log_e("timeout");
-            stopSong();
-            return 0;
+void VS1053::chunkedParse(){
+    // consumes chunk headers and the CRLF after the chunk data as far as they are available, stops at the chunk data
+    // e.g. "1a2f;ext=x\r\n" <0x1a2f bytes data> "\r\n" ... "0\r\n" [trailer lines] "\r\n"
+    while(m_chunkState != CHUNK_DATA && m_chunkState != CHUNK_DONE && rxAvail()){
+        int b = rxRead();
+        if(b < 0) return;
+        switch(m_chunkState){
+            case CHUNK_SIZE:
+                if(isxdigit(b)) {
+                    b = toupper(b) - '0';                   // Be sure we have uppercase
+                    if(b > 9) b = b - 7;                    // Translate A..F to 10..15
+                    m_chunkcount = (m_chunkcount << 4) + b;
+                    break;
+                }
+                if(b != '\n') {if(b != '\r') m_chunkState = CHUNK_EXT; break;}
+                // fallthrough
+            case CHUNK_EXT:                                 // chunk extensions are ignored
+                if(b != '\n') break;
+                if(m_f_Log) log_i("chunksize %d", m_chunkcount);
+                if(m_chunkcount) {m_chunkState = CHUNK_DATA; break;}
+                m_chunkState = CHUNK_TRAILER;               // last chunk
+                m_chunkLineLen = 0;
+                break;
+            case CHUNK_DATA_END:                            // CRLF after the chunk data
+                if(b != '\n') break;
+                m_chunkState = CHUNK_SIZE;
+                m_chunkcount = 0;
+                break;
+            case CHUNK_TRAILER:                             // ends with an empty line
+                if(b == '\r') break;
+                if(b != '\n') {m_chunkLineLen++; break;}
+                if(!m_chunkLineLen) m_chunkState = CHUNK_DONE;
+                m_chunkLineLen = 0;
+                break;
         }
-        b = _client->read();
-        byteCounter++;
-        if(b < 0) continue;  // -1 no data available
-        if(b == '\n') break;
-        if(b < '0') continue;
-        // We have received a hexadecimal character.  Decode it and add to the result.
-        b = toupper(b) - '0';                       // Be sure we have uppercase
-        if(b > 9) b = b - 7;                        // Translate A..F to 10..15
-        chunksize = (chunksize << 4) + b;
     }
-    if(m_f_Log) log_i("chunksize %d", chunksize);
-    *bytes = byteCounter;
-    return chunksize;
+}
+//----------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::streamAvail(){
+    // upper limit of the body bytes that can be read now, chunk headers are not subtracted
+    if(!m_f_chunked) return rxAvail();
+    chunkedParse();
+    if(m_chunkState != CHUNK_DATA) return 0;
+    return rxAvail();
+}
+//----------------------------------------------------------------------------------------------------------------------
+size_t VS1053::streamRead(uint8_t* buff, size_t len){
+    // reads the body of the http response, if chunked across as many chunks as available, never blocks
+    if(!m_f_chunked) {size_t res = rxRead(buff, len); m_bodyRead += res; return res;}
+    size_t n = 0;
+    while(n < len){
+        chunkedParse();
+        if(m_chunkState != CHUNK_DATA) break;
+        size_t res = rxRead(buff + n, min(len - n, (size_t)m_chunkcount));
+        if(!res) break;
+        n += res;
+        m_chunkcount -= res;
+        if(!m_chunkcount) m_chunkState = CHUNK_DATA_END;
+    }
+    return n;
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::rxFill(){
+    // one bulk read into m_rxBuf, only if it is empty
+    if(m_rxPos < m_rxLen) return true;
+    rxReset();
+    int av = _client->available();
+    if(av <= 0) return false;
+    int res = _client->read(m_rxBuf, min((size_t)av, sizeof(m_rxBuf)));
+    if(res <= 0) return false;
+    m_rxLen = res;
+    return true;
+}
+//----------------------------------------------------------------------------------------------------------------------
+uint32_t VS1053::rxAvail(){
+    return (m_rxLen - m_rxPos) + _client->available();
+}
+//----------------------------------------------------------------------------------------------------------------------
+int VS1053::rxRead(){
+    if(!rxFill()) return -1;
+    return m_rxBuf[m_rxPos++];
+}
+//----------------------------------------------------------------------------------------------------------------------
+size_t VS1053::rxRead(uint8_t* buff, size_t len){
+    // the rest of m_rxBuf first, bigger blocks are read from the client directly without the detour
+    size_t n = min(len, (size_t)(m_rxLen - m_rxPos));
+    memcpy(buff, m_rxBuf + m_rxPos, n);
+    m_rxPos += n;
+    if(n == len) return n;
+    if(len - n < 64) {                                      // small reads, e.g. playlist characters
+        if(!rxFill()) return n;
+        size_t m = min(len - n, (size_t)(m_rxLen - m_rxPos));
+        memcpy(buff + n, m_rxBuf + m_rxPos, m);
+        m_rxPos += m;
+        return n + m;
+    }
+    int res = _client->read(buff + n, len - n);
+    return res > 0 ? n + res : n;
+}
+//----------------------------------------------------------------------------------------------------------------------
+bool VS1053::chunkedEnd(){
+    // true if the last chunk and the trailer have been received
+    if(!m_f_chunked) return false;
+    chunkedParse();
+    return m_chunkState == CHUNK_DONE;
 }
 //----------------------------------------------------------------------------------------------------------------------
 bool VS1053::readID3V1Tag(){
@@ -3557,10 +5236,10 @@ bool VS1053::readID3V1Tag(){
 }
 //----------------------------------------------------------------------------------------------------------------------
 boolean VS1053::streamDetection(uint32_t bytesAvail){
-    static uint32_t tmr_slow = millis();
-    static uint32_t tmr_lost = millis();
-    static uint8_t  cnt_slow = 0;
-    static uint8_t  cnt_lost = 0;
+    uint32_t& tmr_slow = m_sdet.tmr_slow;
+    uint32_t& tmr_lost = m_sdet.tmr_lost;
+    uint8_t& cnt_slow = m_sdet.cnt_slow;
+    uint8_t& cnt_lost = m_sdet.cnt_lost;
 
     // if within one second the content of the audio buffer falls below the size of an audio frame 100 times,
     // issue a message
@@ -3579,8 +5258,10 @@ boolean VS1053::streamDetection(uint32_t bytesAvail){
         tmr_lost = millis() + 1000;
         if(cnt_lost == 5){ // 5s no data?
             cnt_lost = 0;
+            if(m_pendConn) return false;                         // a reconnect is on its way
             AUDIO_INFO("Stream lost -> try new connection");
-            connecttohost(m_lastHost);
+            if(reconnectKeepBuffer()) return false;              // InBuff plays on meanwhile
+            openHost(m_lastHost, "", "", false);
             return true;
         }
     }
@@ -11,6 +11,7 @@
 
 #include "Arduino.h"
 #include <vector>
+#include <atomic>
 #include "libb64/cencode.h"
 #include "SPI.h"
 #include "SD.h"
@@ -18,12 +19,11 @@
 #include "SPIFFS.h"
 #include "FS.h"
 #include "FFat.h"
+#include "WiFi.h"
 #include "WiFiClient.h"
 #include "WiFiClientSecure.h"
 
-#if ESP_IDF_VERSION_MAJOR >= 5
-    #include "driver/gpio.h"
-#endif
+#include "driver/gpio.h"
 
 #include "vs1053b-patches-flac.h"
 
@@ -41,6 +41,7 @@ extern __attribute__((weak)) void vs1053_icyurl(const char*);
 extern __attribute__((weak)) void vs1053_icydescription(const char*);
 extern __attribute__((weak)) void vs1053_lasthost(const char*);
 extern __attribute__((weak)) void vs1053_eof_stream(const char*); // The webstream comes to an end
+extern __attribute__((weak)) void vs1053_hlsvariant(const char*); // HLS, the adaptive bitrate has changed the variant
 
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -70,8 +71,23 @@ class AudioBuffer {
 //   |<---  ------dataLength--  ------>|<-------freeSpace------->|
 //
 //
+//   single producer / single consumer: one task may write (writeSpace, getWritePtr, bytesWritten) while another
+//   task reads (bufferFilled, getReadPtr, bytesWasRead). m_writePtr is only changed by the producer, m_readPtr
+//   only by the consumer, both are published with release/acquire ordering. readPtr == writePtr means empty,
+//   so one byte always stays free. init() and resetBuffer() must not run while the other side is active.
+//
+//   getReadSpan() returns the readable data as one or two segments (second one after the wraparound), the
+//   consumer can use them without the copy into the reserved area that getReadPtr() needs
+//
+//   reserve() is the producer counterpart, it returns up to len writable bytes in one or two segments. The data
+//   can be written (or read from the network) directly into them and is published with commit()
 
 public:
+    typedef struct {
+        uint8_t* ptr1;  size_t len1;            // first segment, ends at m_endPtr at the latest
+        uint8_t* ptr2;  size_t len2;            // second segment from m_buffer (after wraparound), can be empty
+    } span_t;
+
     AudioBuffer(size_t maxBlockSize = 0);       // constructor
     ~AudioBuffer();                             // frees the buffer
     size_t   init();                            // set default values
@@ -83,7 +99,10 @@ public:
     void     bytesWritten(size_t bw);           // update writepointer
     void     bytesWasRead(size_t br);           // update readpointer
     uint8_t* getWritePtr();                     // returns the current writepointer
+    span_t   reserve(size_t len);               // up to len writable bytes in one or two segments
+    void     commit(size_t len);                // publish len bytes written into the reserved segments
     uint8_t* getReadPtr();                      // returns the current readpointer
+    span_t   getReadSpan(size_t maxLen);        // up to maxLen readable bytes in one or two segments, no copy
     uint32_t getWritePos();                     // write position relative to the beginning
     uint32_t getReadPos();                      // read position relative to the beginning
     void     resetBuffer();                     // restore defaults
@@ -92,17 +111,13 @@ protected:
     const size_t m_buffSizePSRAM    = 300000;   // most webstreams limit the advance to 100...300Kbytes
     const size_t m_buffSizeRAM      = 1600 * 10;
     size_t       m_buffSize         = 0;
-    size_t       m_freeSpace        = 0;
-    size_t       m_writeSpace       = 0;
-    size_t       m_dataLength       = 0;
     size_t       m_resBuffSizeRAM   = 1600;     // reserved buffspace, >= one mp3  frame
     size_t       m_resBuffSizePSRAM = 4096;
     size_t       m_maxBlockSize     = 1600;
     uint8_t*     m_buffer           = NULL;
-    uint8_t*     m_writePtr         = NULL;
-    uint8_t*     m_readPtr          = NULL;
     uint8_t*     m_endPtr           = NULL;
-    bool         m_f_start          = true;
+    std::atomic<uint8_t*> m_writePtr{NULL};     // owned by the producer
+    std::atomic<uint8_t*> m_readPtr{NULL};      // owned by the consumer
 };
 //----------------------------------------------------------------------------------------------------------------------
 
@@ -114,10 +129,234 @@ private:
     WiFiClient            client;       // @suppress("Abstract class cannot be instantiated")
     WiFiClientSecure      clientsecure; // @suppress("Abstract class cannot be instantiated")
     WiFiClient*          _client = nullptr;
+    WiFiClient*           m_heapClient = nullptr; // _client if it is on the heap (async or pooled), deleted in setDefaults()
+    bool                  m_f_heapClientSsl = false;
+    char*                 m_connHost = NULL;      // host (without port) _client is connected to, NULL = unknown
+    uint16_t              m_connPort = 0;
+    bool                  m_f_connSsl = false;
+    bool                  m_f_connClose = false;  // the server closes the connection after this response
+    uint32_t              m_bodyRead = 0;         // body bytes of this response read by streamRead(), not chunked
+    uint8_t               m_rxBuf[1024];          // bulk read from _client, header, playlist and chunk headers are
+    uint16_t              m_rxPos = 0;            // split in here, the rest goes to the body readers
+    uint16_t              m_rxLen = 0;
+
+    typedef struct {                                // idle keep-alive connection, httpPrint() takes it back
+        WiFiClient*  client;
+        char*        host;                          // without port
+        uint16_t     port;
+        bool         ssl;
+        bool         heap;                          // false: it is the member client or clientsecure
+        uint32_t     lastUse;                       // millis() when it was parked
+    } kaConn_t;
+    static const uint8_t  KA_POOL_SIZE = 2;         // e.g. playlist host and segment host of a HLS stream
+    static const uint16_t KA_IDLE_MS   = 15000;     // most servers close idle connections after 15...60s
+    static const uint32_t KA_TLS_HEAP  = 60000;     // free heap needed to park a TLS client (~40KB each)
+    kaConn_t              m_kaPool[KA_POOL_SIZE] = {};
+
+    typedef struct {                                // connection that connectTask() sets up in the background
+        WiFiClient*  client;                        // WiFiClient or WiFiClientSecure, heap
+        char*        host;                          // full URL, becomes m_lastHost
+        char*        hostwoext;
+        char*        rqh;                           // http request header, sent after connect
+        uint16_t     port;
+        uint16_t     timeout;
+        bool         ssl;
+        uint8_t      expectedCodec;
+        uint8_t      expectedPlsFmt;
+        uint32_t     t0;                            // millis() at start
+        uint32_t     dt;                            // connect time in ms (TCP + TLS handshake)
+        uint32_t     dns;                           // name resolution time in ms
+        bool         resume;                        // reconnect of the running stream, InBuff is kept
+        char*        hdr;                           // response header as received, replayed through m_rxBuf
+        uint16_t     hdrLen;
+        uint8_t      redirects;
+        std::atomic<uint8_t> state;                 // PEND_xxx, the cancel/finish race is decided here
+    } pendConn_t;
+    enum : uint8_t { PEND_CONNECTING = 0, PEND_CONNECTED = 1, PEND_FAILED = 2, PEND_CANCELLED = 3 };
+    pendConn_t*           m_pendConn = NULL;
+
+    // state that the stream functions keep between two calls, one set per instance
+    typedef struct {                                // processLocalFile()
+        bool     f_stream;
+        std::atomic<bool> f_eof;                    // the last block is read, a short read is not a full buffer
+    } plf_t;
+    typedef struct {                                // processWebStream()
+        bool     f_stream;                          // first audio data received
+        uint32_t muteTime;
+        bool     f_mute;
+        uint8_t  cnt;
+    } pwst_t;
+    typedef struct {                                // processWebStreamTS()
+        bool     f_stream;
+        bool     f_firstPacket;
+        bool     f_chunkFinished;
+        uint32_t byteCounter;
+        uint8_t  ts_packet[188];                    // m3u8 transport stream is 188 bytes long
+        uint8_t  ts_packetPtr;
+        uint32_t muteTime;
+        bool     f_mute;
+        uint8_t  cnt;
+    } pwsts_t;
+    typedef struct {                                // processWebStreamHLS()
+        bool     f_stream;
+        bool     firstBytes;
+        bool     f_chunkFinished;
+        uint32_t byteCounter;
+        uint16_t ID3WritePtr;
+        uint16_t ID3ReadPtr;
+        uint8_t* ID3Buff;
+        uint32_t muteTime;
+        bool     f_mute;
+        uint8_t  cnt;
+    } pwsHLS_t;
+    typedef struct {                                // processWebFile()
+        bool     f_stream;
+        bool     f_webFileDataComplete;
+        uint32_t byteCounter;
+        size_t   audioDataCount;
+        uint32_t muteTime;
+        bool     f_mute;
+        uint8_t  cnt;
+    } pwf_t;
+    typedef struct {                                // parsePlaylist_M3U8()
+        uint64_t xMedSeq;
+        boolean  f_mediaSeq_found;
+    } m3u8_t;
+    typedef struct {                                // read_ID3_Header()
+        size_t   headerSize;
+        size_t   id3Size;
+        uint8_t  ID3version;
+        int      ehsz;
+        char     frameid[5];
+        size_t   framesize;
+        bool     compressed;
+        bool     APIC_seen;
+        size_t   APIC_size;
+        uint32_t APIC_pos;
+    } id3_t;
+    typedef struct {
+        int      number;
+        int      pids[4];
+    } pid_array_t;
+    typedef struct {                                // ts_parsePacket()
+        pid_array_t pidsOfPMT;
+        int      PES_DataLength;
+        int      pidOfAAC;
+        uint8_t  fillData;
+    } tspp_t;
+    typedef struct {                                // readMetadata()
+        uint16_t pos_ml;                            // current position in metaline
+        uint16_t metalen;
+    } rmet_t;
+    typedef struct {                                // streamDetection()
+        uint32_t tmr_slow;
+        uint32_t tmr_lost;
+        uint8_t  cnt_slow;
+        uint8_t  cnt_lost;
+    } sdet_t;
+    typedef struct {                                // adaptive bitrate for HLS master playlists
+        std::vector<char*>    url;                  // EXT-X-STREAM-INF variants, absolute URLs
+        std::vector<uint32_t> bw;                   // BANDWIDTH= in bit/s, same index as url
+        int16_t  cur;                               // index of the playing variant, -1 = none
+        uint32_t throughput;                        // moving average of the segment throughput in bit/s, 0 = unknown
+        uint32_t tStart;                            // millis() of the segment request
+        uint32_t tLast;                             // millis() of the last processWebStreamTS/HLS() call
+        uint32_t blockedMs;                         // time the download has waited for space in InBuff
+        bool     fresh;                             // a segment has been measured since the last switch
+    } abr_t;
+    plf_t                 m_plf    = {};
+
+    typedef struct {                                // first frame of a local mp3 file, for setAudioPlayPosition()
+        uint32_t firstFrame;                        // file position of the first frame (Xing/Info/VBRI or audio)
+        uint32_t frames;                            // 0 = unknown, CBR without Info header
+        uint32_t bytes;                             // audio bytes from the first frame on
+        uint32_t sampleRate;
+        uint32_t bitRate;                           // of the first frame, bit/s
+        uint16_t samplesPerFrame;
+        bool     f_toc;
+        uint8_t  toc[100];                          // byte position (n/256 of bytes) at 0...99% of the duration
+    } mp3Info_t;
+    mp3Info_t             m_mp3    = {};
+
+    typedef struct {                                // appendNextFile(), the previous track is still in InBuff
+        uint32_t  left;                             // its bytes not yet sent to the decoder, 0 = nothing pending
+        char*     prevName;                         // for vs1053_eof_mp3()
+        mp3Info_t mp3;                              // of the next track, valid when left reaches 0
+        uint32_t  dataStart;
+        uint32_t  dataSize;
+    } gapless_t;
+    gapless_t             m_gapless = {};
+
+    typedef struct {                                // read_FLAC_Header()
+        uint32_t sampleRate;
+        uint8_t  channels;
+        uint8_t  bitsPerSample;
+        uint64_t totalSamples;                      // 0 = unknown
+        uint32_t audioStart;                        // position of the first frame in the stream
+        uint32_t pos;                               // metadata bytes parsed so far
+        uint32_t blockLeft;                         // of the current metadata block
+        uint8_t  blockType;
+        bool     f_last;                            // the current block is the last one
+        uint8_t  streamInfo[34];                    // the decoder gets it in front of the first frame
+    } flacInfo_t;
+    typedef struct {
+        uint64_t sample;                            // first sample of the target frame
+        uint32_t offset;                            // from audioStart
+    } flacSeekPoint_t;
+    flacInfo_t            m_flac   = {};
+    std::vector<flacSeekPoint_t> m_flacSeek;        // SEEKTABLE without placeholders
+
+    typedef struct {                                // read_M4A_Header(), first audio track of a M4A file
+        uint32_t pos;                               // stream (file) position of the parser
+        uint32_t boxLeft;                           // bytes of the current box not read yet
+        uint32_t moovEnd;                           // 0 = moov not seen yet
+        uint8_t  table;                             // M4A_STSZ ... M4A_CO64, entries are read
+        uint8_t  entrySize;
+        uint32_t entriesLeft;
+        uint32_t tsTrak, durTrak;                   // mdhd of the current trak
+        uint32_t timescale, duration;               // mdhd of the audio trak
+        uint32_t delta;                             // stts, duration of a sample in timescale units
+        uint32_t sampleSize;                        // stsz, 0 = every sample has its own size
+        uint32_t sampleCount;
+        uint8_t  objType, freqIdx, chanCfg;         // AudioSpecificConfig from esds, for the ADTS header
+        bool     f_asc;                             // esds with AAC found
+        bool     f_sound;                           // the current trak is the audio track
+        bool     f_tables;                          // the audio track is complete
+        bool     f_moov;                            // moov is read, waiting for the first sample
+        bool     f_keep;                            // range request of the parser, setDefaults() keeps this
+        bool     f_demux;                           // InBuff holds mdat, sendSpan() adds the ADTS headers
+        uint32_t sample, chunk, inChunk, stscIdx;   // sample iterator
+        uint32_t offset;                            // file position of the current sample
+        uint32_t sampleLeft;                        // bytes of the current sample not sent yet
+        uint32_t streamPos;                         // file position of the InBuff read pointer
+    } m4a_t;
+    typedef struct {
+        uint32_t firstChunk;                        // 1 based
+        uint32_t spc;                               // samples per chunk
+    } m4aStsc_t;
+    enum : uint8_t { M4A_STSZ = 1, M4A_STSC = 2, M4A_STCO = 3, M4A_CO64 = 4 };
+    m4a_t                 m_m4a    = {};
+    std::vector<uint16_t> m_m4aSize;                // stsz
+    std::vector<uint32_t> m_m4aChunk;               // stco/co64
+    std::vector<m4aStsc_t> m_m4aStsc;
+    uint16_t              m_seekSec = 0;            // SCI_DECODE_TIME counts from here, see setAudioPlayPosition()
+    pwst_t                m_pwst   = {};
+    pwsts_t               m_pwsts  = {};
+    pwsHLS_t              m_pwsHLS = {};
+    pwf_t                 m_pwf    = {};
+    m3u8_t                m_m3u8   = {};
+    id3_t                 m_id3    = {};
+    tspp_t                m_tspp   = {};
+    rmet_t                m_rmet   = {};
+    sdet_t                m_sdet   = {};
+    abr_t                 m_abr    = {};
+    bool                  m_f_inBuffInit = false; // InBuff has been allocated
     File audiofile;
     std::vector<char*>    m_playlistContent; // m3u8 playlist buffer
     std::vector<char*>    m_playlistURL;     // m3u8 streamURLs buffer
     std::vector<uint32_t> m_hashQueue;
+    std::vector<char*>    m_playQueue;       // paths or URLs that follow the current track
+    std::vector<fs::FS*>  m_playQueueFS;     // filesystem of the entry in m_playQueue, NULL for URLs
 
 private:
     const char *codecname[10] = {"unknown", "WAV", "MP3", "AAC", "M4A", "FLAC", "AACP", "OPUS", "OGG", "VORBIS" };
@@ -128,11 +367,23 @@ private:
     enum : int { CODEC_NONE = 0, CODEC_WAV = 1, CODEC_MP3 = 2, CODEC_AAC = 3, CODEC_M4A = 4, CODEC_FLAC = 5,
                  CODEC_AACP = 6, CODEC_OPUS = 7, CODEC_OGG = 8, CODEC_VORBIS = 9};
     enum : int { ST_NONE = 0, ST_WEBFILE = 1, ST_WEBSTREAM = 2};
+    enum : uint8_t { CHUNK_SIZE = 0, CHUNK_EXT = 1, CHUNK_DATA = 2, CHUNK_DATA_END = 3, CHUNK_TRAILER = 4, CHUNK_DONE = 5};
 
 private:
     uint8_t       cs_pin ;                        	// Pin where CS line is connected
     uint8_t       dcs_pin ;                       	// Pin where DCS line is connected
     uint8_t       dreq_pin ;                      	// Pin where DREQ line is connected
+    SemaphoreHandle_t m_dreqSem = NULL;             // given by dreqISR() on the DREQ rising edge
+    static const uint16_t DREQ_TIMEOUT_MS = 100;    // a full FIFO drains 32 bytes in 8 ms even at 32 kbit/s
+    SemaphoreHandle_t m_mutex = NULL;               // recursive, serializes loop() and the public commands
+    TaskHandle_t  m_loopTaskHandle = NULL;          // set while the built-in loop task runs
+    volatile bool m_f_loopTaskStop = false;
+    SemaphoreHandle_t m_fileMutex = NULL;           // recursive, audiofile and the producer side of InBuff
+    TaskHandle_t  m_readerTaskHandle = NULL;        // set while the SD reader task runs
+    std::atomic<bool> m_f_readerTaskStop{false};
+    std::atomic<bool> m_f_localAudio{false};        // the file header is parsed, readLocalBlock() reads the audio
+    std::atomic<bool> m_f_fileBusy{false};          // readLocalBlock() reads audiofile without m_fileMutex
+    uint32_t      m_fileGen = 0;                    // counts seeks and closes, under m_fileMutex
     uint16_t      m_vol = 0;                        // volume
     uint8_t       m_vol_steps = 21;                 // default
 
@@ -186,6 +437,12 @@ private:
     uint16_t        m_datamode=0;                   // Statemaschine
     bool            m_f_chunked = false ;           // Station provides chunked transfer
     bool            m_f_ctseen=false;               // First line of header seen or not
+    char            m_rhl[512];                     // responseHeaderline, filled across several loop() calls
+    uint16_t        m_rhlPos = 0;                   // write position in m_rhl
+    uint32_t        m_rhTime = 0;                   // millis() of the first header byte, 0 = nothing received yet
+    uint32_t        m_plTime = 0;                   // millis() of the last playlist byte, 0 = not started, the lines
+                                                    // are collected in m_rhl like the header lines
+    uint32_t        m_plCount = 0;                  // playlist bytes read
     bool            m_f_firstchunk=true;            // First chunk as input
     bool            m_f_metadata = false;           // Stream without metadata
     bool            m_f_tts = false;                // text to speech
@@ -196,22 +453,44 @@ private:
     bool            m_f_firstCall = false;          // InitSequence for processWebstream and processLokalFile
     bool            m_f_firstM3U8call = false;      // InitSequence for m3u8 parsing
     bool            m_f_m3u8data = false;           // used in processM3U8entries
+    uint32_t        m_m3u8SegmentSize = 0;          // bytes of the last HLS segment
+    uint32_t        m_m3u8ReloadTime = 0;           // millis() of the last playlist request
+    uint8_t         m_abrPolicy = ABR_AUTO;         // ABR_xxx, see setHLSBitratePolicy()
+    uint8_t         m_abrSafety = 70;               // a variant may use this percentage of the throughput
+    static const uint16_t ABR_DOWN_MS = 3000;       // less play time in InBuff: one variant down
+    static const uint16_t ABR_UP_MS   = 8000;       // more: one variant up if the throughput allows it
     bool            m_f_psramFound = false;         // set in constructor, result of psramInit()
     bool            m_f_timeout = false;            //
     int             m_LFcount;                      // Detection of end of header
-    uint32_t        m_chunkcount = 0 ;              // Counter for chunked transfer
+    uint32_t        m_chunkcount = 0 ;              // Counter for chunked transfer, bytes left in the current chunk
+    uint8_t         m_chunkState = 0;               // CHUNK_xxx, chunk decoder in streamRead()
+    uint16_t        m_chunkLineLen = 0;             // length of the current trailer line
     uint32_t        m_contentlength = 0;
     uint32_t        m_resumeFilePos = 0;
+    uint32_t        m_rangeReq = 0;                 // first byte requested with "Range:", 0 = whole file
+    uint32_t        m_webFileOffset = 0;            // position of the first body byte in the webfile (Content-Range)
+    uint32_t        m_webFileSize = 0;              // size of the whole webfile, 0 = unknown
+    bool            m_f_acceptRanges = false;       // the server can send parts of the webfile
+    bool            m_f_resumed = false;            // reconnected, InBuff still holds the audio of the old connection
+    bool            m_f_resync = false;             // skip the new data up to the next frame header
+    uint32_t        m_resyncSkipped = 0;            // bytes thrown away while searching the frame header
     uint32_t        m_metaint = 0;                  // Number of databytes between metadata
     uint32_t        m_t0 = 0;                       // store millis(), is needed for a small delay
-    uint16_t        m_bitrate = 0;                  // Bitrate in kb/sec
+    uint32_t        m_bitrate = 0;                  // Bitrate in bit/s (icy-br)
+    uint16_t        m_lfBlock = 16384;              // local files are read in blocks of this size, see setLocalReadBlock()
+    uint16_t        m_prebufMs = 0;                 // audio in InBuff before playback starts, see setPrebufferTime()
+    uint16_t        m_rebufMs = 0;                  // after an underrun, 0 = no rebuffering
+    uint32_t        m_decBitrate = 0;               // measured by the decoder once playback runs, see bufferReady()
+    uint32_t        m_decBitrateTime = 0;           // millis() of the last measurement
+    bool            m_f_rebuffering = false;        // underrun, playAudioData() waits for m_rebufMs
+    uint32_t        m_rebufTime = 0;                // millis() of the underrun
     int16_t         m_btp=0;                        // Bytes to play
     uint16_t        m_streamTitleHash = 0;          // remember streamtitle, ignore multiple occurence in metadata
     uint16_t        m_streamUrlHash = 0;            // remember streamURL, ignore multiple occurence in metadata
     uint16_t        m_timeout_ms = 250;
     uint16_t        m_timeout_ms_ssl = 2700;
     uint32_t        m_metacount=0;                  // Number of bytes in metadata
-    uint16_t        m_m3u8_targetDuration = 10;     //
+    uint16_t        m_m3u8_targetDuration = 10;     // EXT-X-TARGETDURATION in seconds, 0 = unknown
     int             m_controlCounter = 0;           // Status within readID3data() and readWaveHeader()
     bool            m_f_running = false;
     bool            m_f_webstream = false ;         // Play from URL
@@ -234,16 +513,50 @@ protected:
         inline void DCS_LOW()  {(dcs_pin&0x20) ? GPIO.out1_w1tc.data = 1 << (dcs_pin - 32) : GPIO.out_w1tc = 1 << dcs_pin;}
         inline void CS_HIGH()  {( cs_pin&0x20) ? GPIO.out1_w1ts.data = 1 << ( cs_pin - 32) : GPIO.out_w1ts = 1 <<  cs_pin;}
         inline void CS_LOW()   {( cs_pin&0x20) ? GPIO.out1_w1tc.data = 1 << ( cs_pin - 32) : GPIO.out_w1tc = 1 <<  cs_pin;}
+        inline bool DREQ()     {return (dreq_pin&0x20) ? (GPIO.in1.data >> (dreq_pin - 32)) & 1 : (GPIO.in >> dreq_pin) & 1;}
     #else
         inline void DCS_HIGH() {gpio_set_level((gpio_num_t)dcs_pin, 1);}
         inline void DCS_LOW()  {gpio_set_level((gpio_num_t)dcs_pin, 0);}
         inline void CS_HIGH()  {gpio_set_level((gpio_num_t) cs_pin, 1);}
         inline void CS_LOW()   {gpio_set_level((gpio_num_t) cs_pin, 0);}
+        inline bool DREQ()     {return gpio_get_level((gpio_num_t)dreq_pin);}
     #endif
 
-
-    inline void await_data_request() {while(!digitalRead(dreq_pin)) NOP();}	  // Very short delay
-    inline bool data_request()     {return(digitalRead(dreq_pin) == HIGH);}
+    static void IRAM_ATTR dreqISR(void* arg);
+    static void loopTask(void* param);
+    static void readerTask(void* param);
+    static void connectTask(void* param);
+    static void freePendConn(pendConn_t* pc);
+    static bool timedConnect(WiFiClient* c, const char* host, uint16_t port, uint16_t timeout, uint32_t* dnsMs,
+                             uint32_t* connMs);
+    void        cancelPendingConnection();
+    void        processPendingConnection();
+    int         pendReadHeader(pendConn_t* pc, char** location);
+    bool        reconnectKeepBuffer();
+    int         findFrameSync(const uint8_t* buf, size_t len);
+    uint16_t    mp3FrameLength(const uint8_t* h, uint32_t* sampleRate = NULL, uint32_t* bitRate = NULL);
+    void        readMP3Info(uint8_t* data, size_t len, uint32_t filePos, uint32_t audioBytes);
+    bool        openHost(const char* host, const char* user, const char* pwd, bool async, uint32_t rangeStart = 0);
+    bool        openFile(fs::FS &fs, const char* path, uint32_t resumeFilePos = 0);
+    bool        appendNextFile();
+    void        gaplessAdvance(size_t bytesSent);
+    bool        playNextInQueue();
+
+    class lock_t {                                          // holds m_mutex for the lifetime of the object
+        SemaphoreHandle_t m_mtx;
+    public:
+        lock_t(SemaphoreHandle_t mtx) : m_mtx(mtx) {if(m_mtx) xSemaphoreTakeRecursive(m_mtx, portMAX_DELAY);}
+        ~lock_t() {if(m_mtx) xSemaphoreGiveRecursive(m_mtx);}
+    };
+    class fileLock_t : public lock_t {                      // m_fileMutex for a seek, read or close of audiofile outside
+    public:                                                 // readLocalBlock(), a read in progress is waited for and
+        fileLock_t(VS1053* vs) : lock_t(vs->m_fileMutex) {  // dropped
+            while(vs->m_f_fileBusy) vTaskDelay(1);
+            vs->m_fileGen++;
+        }
+    };
+    void        await_data_request();                       // sleeps until the DREQ rising edge if DREQ is low
+    inline bool data_request()     {return DREQ();}
 
     void     initInBuff();
     void     control_mode_on();
@@ -252,8 +565,13 @@ protected:
     void     data_mode_off();
     uint16_t read_register ( uint8_t _reg ) ;
     void     write_register ( uint8_t _reg, uint16_t _value );
+    void     write_register_run(uint8_t _reg, const uint16_t* values, uint16_t n, bool repeat);
     void     sdi_send_buffer ( uint8_t* data, size_t len ) ;
     size_t   sendBytes(uint8_t* data, size_t len);
+    size_t   sendSpan(size_t maxLen);
+    size_t   readToInBuff(size_t len);
+    size_t   writeToInBuff(const uint8_t* data, size_t len);
+    size_t   demuxToInBuff(size_t len);
     void     sdi_send_fillers ( size_t length ) ;
     void     wram_write ( uint16_t address, uint16_t data ) ;
     uint16_t wram_read ( uint16_t address ) ;
@@ -264,37 +582,87 @@ protected:
                                                          // the last playChunk call.
     void     urlencode(char* buff, uint16_t buffLen, bool spacesOnly = false);
     int      read_ID3_Header(uint8_t *data, size_t len);
+    int      read_FLAC_Header(uint8_t *data, size_t len);
+    bool     flacSeek(uint16_t sec);
+    int      read_M4A_Header(uint8_t *data, size_t len);
+    void     m4aParseBox(const char* type, uint8_t* p, uint32_t len);
+    int      m4aMoovDone();
+    int      m4aError(const char* msg);
+    void     m4aSeekFile(uint32_t pos);
+    bool     m4aRangeRequest(uint32_t pos);
+    void     m4aReconnected();
+    void     m4aClear();
+    void     m4aStartDemux();
+    void     m4aFirstSample();
+    void     m4aNextSample();
+    uint32_t m4aSampleSize(uint32_t i);
+    size_t   m4aSendSpan(size_t maxLen);
+    bool     m4aSeek(uint16_t sec);
     void     showID3Tag(const char* tag, const char* value);
     bool     httpPrint(const char* host);
+    void     setConnHost(const char* host, uint16_t port, bool ssl);
+    bool     bodyComplete();
+    bool     drainBody();
+    void     parkConnection();
+    WiFiClient* takeConnection(const char* host, uint16_t port, bool ssl);
+    void     dropPooled(uint8_t slot);
+    void     clearConnPool();
     void     processLocalFile();
     void     processWebStream();
     void     processWebStreamTS();
     void     processWebStreamHLS();
     void     processWebFile();
     void     playAudioData();
+    size_t   localReadBlock();
+    size_t   readLocalBlock();
+    void     readerWake() {if(m_readerTaskHandle) xTaskNotifyGive(m_readerTaskHandle);}
+    void     restartDecodeAt(uint16_t sec, bool flush);
+    size_t   prebufferBytes(uint16_t ms);
+    bool     bufferReady(bool started, bool eof);
     bool     readPlayListData();
+    // earlier-request threshold: the next HLS segment is requested once half of the last one fits into InBuff,
+    // over the same connection after the current one is complete
+    bool     m3u8EarlyRequest() {return !m_f_psramFound || InBuff.freeSpace() > m_m3u8SegmentSize / 2;}
     const char* parsePlaylist_M3U();
     const char* parsePlaylist_PLS();
     const char* parsePlaylist_ASX();
     const char* parsePlaylist_M3U8();
     const char* m3u8redirection();
+    char*    m3u8AbsoluteURL(const char* base, const char* url);
+    int16_t  abrBest(uint32_t budget);
+    int16_t  abrStep(int16_t from, bool up);
+    void     abrSegmentStart();
+    void     abrTick();
+    void     abrSegmentDone(uint32_t bytes);
+    bool     abrSwitch();
     uint64_t m3u8_findMediaSeqInURL();
     bool     STfromEXTINF(char* str);
     size_t   process_m3u8_ID3_Header(uint8_t* packet);
     bool     parseContentType(char* ct);
     bool     latinToUTF8(char* buff, size_t bufflen);
     bool     parseHttpResponseHeader();
+    bool     readResponseHeaderLine();
     void     UTF8toASCII(char* str);
     void     unicode2utf8(char* buff, uint32_t len);
     void     setDefaults();
     bool     ts_parsePacket(uint8_t* packet, uint8_t* packetStart, uint8_t* packetLength);
-    uint16_t readMetadata(uint16_t maxBytes, bool first = false);
-    size_t   chunkedDataTransfer(uint8_t* bytes);
+    size_t   readMetadata(const uint8_t* data, size_t len);
+    void     chunkedParse();
+    uint32_t streamAvail();
+    bool     rxFill();
+    uint32_t rxAvail();
+    int      rxRead();
+    size_t   rxRead(uint8_t* buff, size_t len);
+    void     rxReset() {m_rxPos = m_rxLen = 0;}
+    size_t   streamRead(uint8_t* buff, size_t len);
+    bool     chunkedEnd();
     bool     readID3V1Tag();
     boolean  streamDetection(uint32_t bytesAvail);
     uint8_t  determineOggCodec(uint8_t* data, uint16_t len);
 
 public:
+    // the public calls can be used from any task: whatever touches the chip, the connection or the play state
+    // takes m_mutex, the getters of a single value (isRunning(), getVolume(), bufferFilled()...) need no lock
     // Constructor.  Only sets pin values.  Doesn't touch the chip.  Be sure to call begin()!
     VS1053(uint8_t _cs_pin, uint8_t _dcs_pin, uint8_t _dreq_pin, uint8_t spi, uint8_t mosi, uint8_t miso, uint8_t sclk);
     ~VS1053();
@@ -313,21 +681,42 @@ public:
     uint32_t getBitRate();                              // average br from WRAM register
     void     softReset() ;                              // Do a soft reset
     void     loop();
+    bool     startTask(uint8_t core = 1, uint8_t prio = 2, uint32_t stackSize = 8192); // run loop() in its own task
+    void     stopTask();
+    bool     isTaskRunning() {return m_loopTaskHandle != NULL;}
+    bool     startReaderTask(uint8_t core = 0, uint8_t prio = 3, uint32_t stackSize = 3072); // fill InBuff from SD in the background
+    void     stopReaderTask();
     void     setConnectionTimeout(uint16_t timeout_ms, uint16_t timeout_ms_ssl);
     bool     connecttohost(String host);
-    bool     connecttohost(const char* host, const char* user = "", const char* pwd = "");
+    bool     connecttohost(const char* host, const char* user = "", const char* pwd = "", uint32_t resumeFilePos = 0);
+    bool     connecttohostAsync(const char* host, const char* user = "", const char* pwd = ""); // keeps playing until the new host answers
     bool     connecttoSD(String sdfile, uint32_t resumeFilePos = 0);
     bool     connecttoSD(const char* sdfile, uint32_t resumeFilePos = 0);
     bool     connecttoFS(fs::FS &fs, const char* path, uint32_t resumeFilePos = 0);
     bool     connecttospeech(const char* speech, const char* lang);
+    bool     addToPlayQueue(fs::FS &fs, const char* path); // mp3/aac files of the same codec follow gapless
+    bool     addToPlayQueue(const char* url);
+    void     clearPlayQueue();                      // connecttohost(), connecttoFS()... and stop_mp3client() clear it too
+    uint16_t playQueueSize() {lock_t lck(m_mutex); return m_playQueue.size();}
     bool     isRunning() {return m_f_running;}
     bool     pauseResume();
     uint32_t getFileSize();
     uint32_t getFilePos();
     uint32_t getAudioDataStartPos();
     bool     setFilePos(uint32_t pos);
+    bool     setAudioPlayPosition(uint16_t sec);    // local mp3, flac and m4a files, lands on a frame header
+    uint32_t getAudioFileDuration();                // seconds, local mp3, flac and m4a files, 0 = unknown
+    uint32_t getAudioCurrentTime();                 // seconds
     size_t   bufferFilled();
     size_t   bufferFree();
+    enum : uint8_t { ABR_HIGHEST = 0, ABR_LOWEST = 1, ABR_AUTO = 2 }; // HLS variant selection
+    void     setHLSBitratePolicy(uint8_t policy, uint8_t safetyPercent = 70);
+    uint32_t getHLSThroughput() {return m_abr.throughput;}  // bit/s, 0 = not measured yet
+    enum : uint8_t { PREBUFFER_LOW_LATENCY = 0, PREBUFFER_RESILIENT = 1 };
+    void     setPrebufferTime(uint16_t startMs, uint16_t rebufferMs); // ms of audio, 0 = start with one frame
+    void     setPrebufferPreset(uint8_t preset);
+    void     setLocalReadBlock(uint16_t size);      // bytes per SD/FFat read, multiple of 512, default 16384
+    uint32_t benchmarkFS(fs::FS &fs, const char* path, uint16_t blockSize = 0); // sustained read rate in KB/s
     void     loadUserCode();
     int getCodec() {return m_codec;}
     const char *getCodecname() {return codecname[m_codec];}
@@ -459,8 +848,15 @@ public:
 	}
 
     inline uint8_t  getDatamode(){return m_datamode;}
-    inline void     setDatamode(uint8_t dm){m_datamode=dm;}
-    inline uint32_t streamavail(){ return _client ? _client->available() : 0;}
+    inline void     setDatamode(uint8_t dm){
+                        if(dm == HTTP_RESPONSE_HEADER) {m_rhlPos = 0; m_rhTime = 0; m_f_ctseen = false; m_f_timeout = false;
+                                                        m_f_chunked = false; m_chunkState = CHUNK_SIZE; m_chunkcount = 0;
+                                                        m_f_connClose = false; m_bodyRead = 0;
+                                                        m_webFileOffset = 0; m_webFileSize = 0; m_f_acceptRanges = false;}
+                        if(dm == AUDIO_PLAYLISTINIT)   {m_rhlPos = 0; m_plTime = 0; m_plCount = 0;}
+                        m_datamode=dm;
+                    }
+    inline uint32_t streamavail(){ return _client ? rxAvail() : 0;}   // m_rxBuf included
 };
 
 #endif
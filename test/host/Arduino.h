@@ -0,0 +1,80 @@
+// Host build of the library for test/, just enough of the ESP32 Arduino core to compile and link
+// src/vs1053_ext.cpp on a PC. Nothing here talks to hardware: SPI goes nowhere, DREQ is always high,
+// tasks are never started and the semaphores are dummies (the tests are single threaded).
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+#include <algorithm>
+#include <type_traits>
+
+#define ESP_IDF_VERSION_MAJOR 5
+#define IRAM_ATTR
+#define HIGH 1
+#define LOW 0
+#define INPUT 1
+#define OUTPUT 2
+#define INPUT_PULLUP 5
+#define RISING 1
+#define FALLING 2
+#define CHANGE 3
+#define MSBFIRST 1
+#define _BV(b) (1UL << (b))
+#define NOP() do{}while(0)
+#define log_e(...) do{}while(0)
+#define log_i(...) do{}while(0)
+#define log_d(...) do{}while(0)
+#define log_w(...) do{}while(0)
+#define log_v(...) do{}while(0)
+
+typedef bool boolean;
+template<class A, class B> typename std::common_type<A, B>::type min(A a, B b) {return a < b ? a : b;}
+template<class A, class B> typename std::common_type<A, B>::type max(A a, B b) {return a > b ? a : b;}
+
+class String {
+public:
+    String(const char* s = "") {}
+    const char* c_str() const {return "";}
+};
+
+inline unsigned long millis() {return 0;}
+inline unsigned long micros() {return 0;}
+inline void delay(uint32_t) {}
+inline void delayMicroseconds(uint32_t) {}
+inline int  digitalRead(uint8_t) {return HIGH;}
+inline void digitalWrite(uint8_t, uint8_t) {}
+inline void pinMode(uint8_t, uint8_t) {}
+inline long map(long x, long in_min, long in_max, long out_min, long out_max) {
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+inline char toLowerCase(char c) {return tolower(c);}
+inline char* strlwr(char* s) {for(char* p = s; *p; p++) *p = tolower(*p); return s;}
+inline char* lltoa(long long v, char* buf, int base) {sprintf(buf, "%lld", v); return buf;}
+
+#define MALLOC_CAP_DEFAULT  1
+#define MALLOC_CAP_SPIRAM   2
+#define MALLOC_CAP_INTERNAL 4
+inline bool  psramInit() {return true;}
+inline bool  psramFound() {return true;}
+inline void* ps_calloc(size_t n, size_t size) {return calloc(n, size);}
+inline void* ps_malloc(size_t size) {return malloc(size);}
+inline void* heap_caps_malloc(size_t size, uint32_t) {return malloc(size);}
+inline void* heap_caps_malloc_prefer(size_t size, size_t, ...) {return malloc(size);}
+inline size_t heap_caps_get_largest_free_block(uint32_t) {return 4 * 1024 * 1024;}
+
+struct EspClass {
+    uint32_t getFreeHeap() {return 4 * 1024 * 1024;}
+    uint32_t getFreePsram() {return 4 * 1024 * 1024;}
+};
+inline EspClass ESP;
+
+inline void attachInterruptArg(uint8_t, void (*)(void*), void*, int) {}
+inline void attachInterrupt(uint8_t, void (*)(void), int) {}
+inline void detachInterrupt(uint8_t) {}
+
+#include "freertos/FreeRTOS.h"
+#include "driver/gpio.h"
@@ -0,0 +1,44 @@
+#pragma once
+#include "Arduino.h"
+namespace fs {
+enum SeekMode {SeekSet = 0, SeekCur = 1, SeekEnd = 2};
+
+class File {                                                // a file in memory, the test owns the data
+public:
+    File() {}
+    File(const uint8_t* data, size_t size, const char* name = "test") : m_data(data), m_size(size), m_name(name) {}
+    size_t read(uint8_t* buf, size_t len) {
+        size_t n = m_pos < m_size ? std::min(len, m_size - m_pos) : 0;
+        memcpy(buf, m_data + m_pos, n);
+        m_pos += n;
+        return n;
+    }
+    int read() {return m_pos < m_size ? m_data[m_pos++] : -1;}
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+        size_t p = mode == SeekSet ? pos : mode == SeekCur ? m_pos + pos : m_size + pos;
+        if(p > m_size) return false;
+        m_pos = p;
+        return true;
+    }
+    size_t position() const {return m_pos;}
+    size_t size() const {return m_size;}
+    void close() {m_data = NULL; m_size = m_pos = 0;}
+    operator bool() const {return m_data != NULL;}
+    const char* name() const {return m_name;}
+    const char* path() const {return m_name;}
+    int available() {return m_size - m_pos;}
+private:
+    const uint8_t* m_data = NULL;
+    size_t         m_size = 0;
+    size_t         m_pos  = 0;
+    const char*    m_name = "";
+};
+
+class FS {                                                  // empty, use the File constructor
+public:
+    File open(const char*, const char* mode = "r") {return File();}
+    bool exists(const char*) {return false;}
+};
+}
+using fs::File;
+using fs::FS;
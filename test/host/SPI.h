@@ -0,0 +1,24 @@
+#pragma once
+#include "Arduino.h"
+#define SPI_MODE0 0
+#define VSPI 3
+#define HSPI 2
+class SPISettings {
+public:
+    SPISettings() {}
+    SPISettings(uint32_t, uint8_t, uint8_t) {}
+};
+class SPIClass {                                            // writes go nowhere, reads return 0
+public:
+    SPIClass(uint8_t bus = 0) {}
+    void begin(int8_t = -1, int8_t = -1, int8_t = -1, int8_t = -1) {}
+    void beginTransaction(SPISettings) {}
+    void endTransaction() {}
+    void write(uint8_t) {}
+    void write16(uint16_t) {}
+    uint8_t transfer(uint8_t) {return 0;}
+    void writeBytes(const uint8_t*, uint32_t) {}
+    void transferBytes(const uint8_t*, uint8_t* out, uint32_t n) {if(out) memset(out, 0, n);}
+    void writePattern(const uint8_t*, uint8_t, uint32_t) {}
+};
+inline SPIClass SPI;
@@ -0,0 +1,6 @@
+#pragma once
+#include "WiFiClient.h"
+struct WiFiClass {
+    int hostByName(const char*, IPAddress&) {return 0;}
+};
+inline WiFiClass WiFi;
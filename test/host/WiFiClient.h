@@ -0,0 +1,31 @@
+#pragma once
+#include "Arduino.h"
+class IPAddress {
+public:
+    IPAddress() {}
+    IPAddress(uint32_t a) : m_addr(a) {}
+    bool fromString(const char*) {return false;}
+    operator uint32_t() const {return m_addr;}
+private:
+    uint32_t m_addr = 0;
+};
+
+class WiFiClient {                                          // never connected, a test derives from it to feed data
+public:
+    WiFiClient() {}
+    virtual ~WiFiClient() {}
+    virtual int connect(const char*, uint16_t, int32_t) {return 0;}
+    virtual int connect(const char*, uint16_t) {return 0;}
+    virtual int connect(IPAddress, uint16_t, int32_t) {return 0;}
+    virtual int available() {return 0;}
+    virtual int read() {return -1;}
+    virtual int read(uint8_t*, size_t) {return -1;}
+    size_t readBytes(uint8_t* buf, size_t len) {int n = read(buf, len); return n > 0 ? n : 0;}
+    size_t readBytes(char* buf, size_t len) {return readBytes((uint8_t*)buf, len);}
+    virtual int peek() {return -1;}
+    virtual size_t write(const uint8_t*, size_t len) {return len;}
+    virtual uint8_t connected() {return 0;}
+    virtual void stop() {}
+    size_t print(const char* s) {return strlen(s);}
+    void setTimeout(uint32_t) {}
+};
@@ -0,0 +1,7 @@
+#pragma once
+#include "WiFiClient.h"
+class WiFiClientSecure : public WiFiClient {
+public:
+    void setInsecure() {}
+    void setHandshakeTimeout(unsigned long) {}
+};
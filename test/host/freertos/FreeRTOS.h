@@ -0,0 +1,39 @@
+#pragma once
+// single threaded host build, see Arduino.h
+#include <stdint.h>
+typedef void* SemaphoreHandle_t;
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef uint32_t TickType_t;
+typedef unsigned int UBaseType_t;
+typedef int BaseType_t;
+#define pdTRUE  1
+#define pdFALSE 0
+#define pdPASS  1
+#define portMAX_DELAY 0xffffffff
+#define pdMS_TO_TICKS(x) (x)
+#define portTICK_PERIOD_MS 1
+#define portYIELD_FROM_ISR(...) do{}while(0)
+#define tskNO_AFFINITY 0x7fffffff
+
+inline void vTaskDelay(TickType_t) {}
+inline void taskYIELD() {}
+inline TaskHandle_t xTaskGetCurrentTaskHandle() {return (TaskHandle_t)1;}
+inline void vTaskDelete(TaskHandle_t) {}
+inline BaseType_t xTaskCreatePinnedToCore(void (*)(void*), const char*, uint32_t, void*, UBaseType_t, TaskHandle_t* h, BaseType_t) {
+    if(h) *h = NULL;
+    return pdFALSE;                                         // no tasks on the host
+}
+inline SemaphoreHandle_t xSemaphoreCreateMutex() {static int m; return &m;}
+inline SemaphoreHandle_t xSemaphoreCreateRecursiveMutex() {static int m; return &m;}
+inline SemaphoreHandle_t xSemaphoreCreateBinary() {static int m; return &m;}
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) {return pdTRUE;}
+inline BaseType_t xSemaphoreGive(SemaphoreHandle_t) {return pdTRUE;}
+inline BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t, TickType_t) {return pdTRUE;}
+inline BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t) {return pdTRUE;}
+inline BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t*) {return pdTRUE;}
+inline void vSemaphoreDelete(SemaphoreHandle_t) {}
+inline uint32_t ulTaskNotifyTake(BaseType_t, TickType_t) {return 0;}
+inline void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*) {}
+inline BaseType_t xTaskNotifyGive(TaskHandle_t) {return pdPASS;}
+inline TickType_t xTaskGetTickCount() {return 0;}
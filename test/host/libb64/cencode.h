@@ -0,0 +1,6 @@
+#pragma once
+typedef struct {int step;} base64_encodestate;
+#define base64_encode_expected_len(n) ((((4 * (n)) / 3) + 3) & ~3)
+inline void base64_init_encodestate(base64_encodestate* s) {s->step = 0;}
+inline int  base64_encode_block(const char*, int, char* out, base64_encodestate*) {*out = 0; return 0;}
+inline int  base64_encode_blockend(char* out, base64_encodestate*) {*out = 0; return 0;}
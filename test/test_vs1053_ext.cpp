@@ -0,0 +1,389 @@
+// Host tests for the parts of vs1053_ext that are plain logic: the AudioBuffer ring, the rx buffer and chunk
+// decoder of the http client, the Xing/VBRI seek of mp3 files and the FLAC SEEKTABLE. The library is compiled
+// for the PC with the shims in host/, see the Makefile. Run "make" in this folder.
+
+#include <vector>
+#include <atomic>
+#include <string>
+#define private public                                      // the tests reach into the private parsers
+#define protected public
+#include "../src/vs1053_ext.cpp"
+#undef private
+#undef protected
+
+static int s_checks = 0, s_failed = 0;
+#define CHECK(cond) do { s_checks++; if(!(cond)) { s_failed++; \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); } } while(0)
+#define CHECK_EQ(a, b) do { s_checks++; long long _a = (long long)(a), _b = (long long)(b); if(_a != _b) { s_failed++; \
+    printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, _a, _b); } } while(0)
+
+//----------------------------------------------------------------------------------------------------------------------
+//      AudioBuffer
+//----------------------------------------------------------------------------------------------------------------------
+static void writeSeq(AudioBuffer& b, size_t len, uint8_t& seq){
+    // writes len bytes of a running counter through reserve()/commit()
+    AudioBuffer::span_t sp = b.reserve(len);
+    CHECK_EQ(sp.len1 + sp.len2, len);
+    for(size_t i = 0; i < sp.len1; i++) sp.ptr1[i] = seq++;
+    for(size_t i = 0; i < sp.len2; i++) sp.ptr2[i] = seq++;
+    b.commit(sp.len1 + sp.len2);
+}
+
+static bool readSeq(AudioBuffer& b, size_t len, uint8_t& seq){
+    // reads len bytes through getReadSpan(), they must continue the counter
+    AudioBuffer::span_t sp = b.getReadSpan(len);
+    bool ok = sp.len1 + sp.len2 == len;
+    for(size_t i = 0; i < sp.len1; i++) ok &= sp.ptr1[i] == seq++;
+    for(size_t i = 0; i < sp.len2; i++) ok &= sp.ptr2[i] == seq++;
+    b.bytesWasRead(sp.len1 + sp.len2);
+    return ok;
+}
+
+static void test_audioBuffer(){
+    AudioBuffer b;
+    const size_t cap = b.init();                            // usable size, one byte always stays free
+    CHECK(cap > 4096);
+    CHECK_EQ(b.bufferFilled(), 0);
+    CHECK_EQ(b.freeSpace(), cap - 1);
+
+    AudioBuffer::span_t sp = b.reserve(cap * 2);            // empty: one segment, readPtr is at the beginning
+    CHECK_EQ(sp.len1, cap - 1);
+    CHECK_EQ(sp.len2, 0);
+    CHECK(sp.ptr2 == NULL);
+
+    uint8_t wseq = 0, rseq = 0;
+    writeSeq(b, cap - 100, wseq);
+    CHECK(readSeq(b, cap - 300, rseq));
+    CHECK_EQ(b.bufferFilled(), 200);
+
+    sp = b.reserve(500);                                    // wraps: 100 bytes up to the end, 400 from the start
+    CHECK_EQ(sp.len1, 100);
+    CHECK_EQ(sp.len2, 400);
+    CHECK(sp.ptr2 == b.m_buffer);
+    writeSeq(b, 500, wseq);
+    CHECK_EQ(b.bufferFilled(), 700);
+    CHECK_EQ(b.bufferFilled() + b.freeSpace(), cap - 1);
+
+    sp = b.getReadSpan(10000);                              // the data in two segments
+    CHECK_EQ(sp.len1, 300);
+    CHECK_EQ(sp.len2, 400);
+
+    uint8_t* rp = b.getReadPtr();                           // the wrapped part is copied behind the end
+    uint8_t s = rseq;
+    bool contiguous = true;
+    for(size_t i = 0; i < 700; i++) contiguous &= rp[i] == s++;
+    CHECK(contiguous);
+
+    CHECK(readSeq(b, 250, rseq));                           // the read side wraps too
+    CHECK(readSeq(b, 450, rseq));
+    CHECK_EQ(b.bufferFilled(), 0);
+    CHECK_EQ(b.getReadPos(), 400);
+
+    sp = b.reserve(cap * 2);                                // full: the writer never reaches the reader
+    CHECK_EQ(sp.len1 + sp.len2, cap - 1);
+    writeSeq(b, cap - 1, wseq);
+    CHECK_EQ(b.freeSpace(), 0);
+    CHECK_EQ(b.reserve(10).len1, 0);
+    CHECK(readSeq(b, cap - 1, rseq));
+
+    for(int round = 0; round < 50; round++) {               // odd sizes, many wraps
+        writeSeq(b, 7919, wseq);
+        CHECK(readSeq(b, 7919, rseq));
+    }
+    CHECK_EQ(b.bufferFilled(), 0);
+
+    b.resetBuffer();
+    CHECK_EQ(b.bufferFilled(), 0);
+    CHECK_EQ(b.getWritePos(), 0);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//      rx buffer and chunked transfer encoding
+//----------------------------------------------------------------------------------------------------------------------
+class MockClient : public WiFiClient {
+    // delivers the response as far as it has been released, like a socket with data on the way
+public:
+    std::string data;
+    size_t      released = 0, pos = 0;
+    int available() override {return min(released, data.size()) - pos;}
+    int read() override {return available() > 0 ? (uint8_t)data[pos++] : -1;}
+    int read(uint8_t* buf, size_t len) override {
+        size_t n = min(len, (size_t)available());
+        if(!n) return -1;
+        memcpy(buf, data.data() + pos, n);
+        pos += n;
+        return n;
+    }
+    uint8_t connected() override {return 1;}
+};
+
+static VS1053* newPlayer(){
+    VS1053* vs = new VS1053(1, 2, 3, VSPI, 23, 19, 18);
+    vs->setDefaults();
+    return vs;
+}
+
+static void delPlayer(VS1053* vs){
+    vs->_client = nullptr;                                  // the clients of the tests are on the stack
+    vs->audiofile = File();
+    delete vs;
+}
+
+static std::string readChunked(const std::string& body, size_t step, size_t readLen, bool* done){
+    VS1053* vs = newPlayer();
+    MockClient c;
+    c.data = body;
+    vs->_client = &c;
+    vs->setDatamode(VS1053::HTTP_RESPONSE_HEADER);
+    vs->m_f_chunked = true;
+    std::string out;
+    uint8_t buf[256];
+    for(int i = 0; i < 100000 && !vs->chunkedEnd(); i++) {
+        c.released += step;                                 // the next bytes arrive
+        size_t n = vs->streamRead(buf, min(readLen, sizeof(buf)));
+        out.append((char*)buf, n);
+    }
+    *done = vs->chunkedEnd();
+    CHECK_EQ(c.available(), 0);
+    CHECK_EQ(vs->streamavail(), 0);
+    delPlayer(vs);
+    return out;
+}
+
+static void test_chunked(){
+    const std::string body = "4\r\nWiki\r\n"
+                             "5;name=value\r\npedia\r\n"
+                             "E\r\n in\r\n\r\nchunks.\r\n"
+                             "1a\r\nabcdefghijklmnopqrstuvwxyz\r\n"
+                             "0\r\nX-Trailer: x\r\n\r\n";
+    const std::string expected = "Wikipedia in\r\n\r\nchunks.abcdefghijklmnopqrstuvwxyz";
+    const size_t steps[] = {1, 2, 3, 7, 4096};              // headers and CRLFs split at every position
+    const size_t reads[] = {1, 5, 64, 256};
+    for(size_t s : steps) for(size_t r : reads) {
+        bool done = false;
+        std::string out = readChunked(body, s, r, &done);
+        CHECK(out == expected);
+        CHECK(done);
+    }
+
+    bool done = true;                                       // without the empty line the body isn't finished
+    std::string out = readChunked("3\r\nabc\r\n0\r\n", 4096, 64, &done);
+    CHECK(out == "abc");
+    CHECK(!done);
+}
+
+static void test_rxBuffer(){
+    VS1053* vs = newPlayer();
+    MockClient c;
+    for(int i = 0; i < 3000; i++) c.data += (char)(i * 7);
+    c.released = c.data.size();
+    vs->_client = &c;
+    vs->setDatamode(VS1053::HTTP_RESPONSE_HEADER);
+
+    CHECK_EQ(vs->streamavail(), 3000);
+    CHECK_EQ(vs->rxRead(), 0);                              // one bulk read into m_rxBuf
+    CHECK_EQ(c.available(), 3000 - sizeof(vs->m_rxBuf));
+    CHECK_EQ(vs->streamavail(), 2999);                      // the bytes in m_rxBuf count
+    CHECK_EQ(vs->streamAvail(), 2999);
+
+    uint8_t buf[3000];
+    size_t n = vs->streamRead(buf, 10);                     // small read from m_rxBuf
+    CHECK_EQ(n, 10);
+    n += vs->streamRead(buf + n, 2000);                     // rest of m_rxBuf, then directly from the client
+    CHECK_EQ(n, 2010);
+    n += vs->streamRead(buf + n, 3000 - n);
+    CHECK_EQ(n, 2999);
+    bool same = true;
+    for(size_t i = 0; i < n; i++) same &= buf[i] == (uint8_t)c.data[i + 1];
+    CHECK(same);
+    CHECK_EQ(vs->streamavail(), 0);
+    CHECK_EQ(vs->rxRead(), -1);
+    delPlayer(vs);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//      mp3, Xing and VBRI
+//----------------------------------------------------------------------------------------------------------------------
+static const uint8_t  s_mp3Hdr[4] = {0xFF, 0xFB, 0x90, 0x00};   // MPEG1 layer III, 128 kbit/s, 44.1 kHz, stereo
+static const uint32_t s_flen = 417;                             // 144 * 128000 / 44100
+static const uint32_t s_lead = 100;                             // bytes in front of the first frame
+
+static void put32(uint8_t* p, uint32_t v){p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;}
+static void put16(uint8_t* p, uint16_t v){p[0] = v >> 8; p[1] = v;}
+
+static std::vector<uint8_t> mp3File(uint32_t frames){
+    // s_lead zero bytes, then frames empty frames of s_flen bytes, the first one for a Xing or VBRI header
+    std::vector<uint8_t> f(s_lead + frames * s_flen, 0);
+    for(uint32_t i = 0; i < frames; i++) memcpy(&f[s_lead + i * s_flen], s_mp3Hdr, 4);
+    return f;
+}
+
+static void test_mp3FrameLength(){
+    VS1053* vs = newPlayer();
+    uint32_t sr = 0, br = 0;
+    CHECK_EQ(vs->mp3FrameLength(s_mp3Hdr, &sr, &br), s_flen);
+    CHECK_EQ(sr, 44100);
+    CHECK_EQ(br, 128000);
+    const uint8_t padded[4] = {0xFF, 0xFB, 0x92, 0x00};
+    CHECK_EQ(vs->mp3FrameLength(padded), s_flen + 1);
+    const uint8_t mpeg2[4] = {0xFF, 0xF3, 0x80, 0x00};      // MPEG2, 64 kbit/s, 22.05 kHz
+    CHECK_EQ(vs->mp3FrameLength(mpeg2, &sr, &br), 72 * 64000 / 22050);
+    CHECK_EQ(sr, 22050);
+    const uint8_t layer2[4] = {0xFF, 0xFD, 0x90, 0x00};
+    CHECK_EQ(vs->mp3FrameLength(layer2), 0);
+    const uint8_t badRate[4] = {0xFF, 0xFB, 0xF0, 0x00};
+    CHECK_EQ(vs->mp3FrameLength(badRate), 0);
+    delPlayer(vs);
+}
+
+static VS1053* mp3Player(std::vector<uint8_t>& f){
+    VS1053* vs = newPlayer();
+    vs->audiofile = File(f.data(), f.size());
+    vs->m_datamode = VS1053::AUDIO_LOCALFILE;
+    vs->m_codec = VS1053::CODEC_MP3;
+    vs->readMP3Info(f.data(), f.size(), 0, f.size());
+    vs->m_controlCounter = 100;                             // the header is done, setAudioPlayPosition() is allowed
+    return vs;
+}
+
+static void test_xing(){
+    std::vector<uint8_t> f = mp3File(1000);
+    uint8_t* x = &f[s_lead + 4 + 32];                       // behind the side information of a stereo MPEG1 frame
+    memcpy(x, "Xing", 4);
+    put32(x + 4, 1 | 2 | 4);                                // frames, bytes, toc
+    put32(x + 8, 1000);
+    put32(x + 12, 1000 * s_flen);
+    for(int i = 0; i < 100; i++) x[16 + i] = i < 50 ? i * 2 : 100 + (i - 50) * 3; // VBR, the second half is denser
+
+    VS1053* vs = mp3Player(f);
+    CHECK_EQ(vs->m_mp3.firstFrame, s_lead);
+    CHECK_EQ(vs->m_mp3.frames, 1000);
+    CHECK_EQ(vs->m_mp3.bytes, 1000 * s_flen);
+    CHECK(vs->m_mp3.f_toc);
+    CHECK_EQ(vs->getAudioFileDuration(), 26);               // 1000 * 1152 / 44100
+
+    // 13 s of 26 s: 50%, toc[50] = 100 -> 100 / 256 * 417000 = 162890, the next frame starts at frame 391
+    CHECK(vs->setAudioPlayPosition(13));
+    CHECK_EQ(vs->audiofile.position(), s_lead + 391 * s_flen);
+    CHECK_EQ(vs->m_seekSec, 13);
+
+    // 5 s: 19.23%, between toc[19] = 38 and toc[20] = 40 -> 38.46 / 256 * 417000 = 62648 -> frame 151
+    CHECK(vs->setAudioPlayPosition(5));
+    CHECK_EQ(vs->audiofile.position(), s_lead + 151 * s_flen);
+
+    CHECK(!vs->setAudioPlayPosition(26));                   // not behind the end
+    delPlayer(vs);
+}
+
+static void test_vbri(){
+    std::vector<uint8_t> f = mp3File(1000);
+    uint8_t* v = &f[s_lead + 36];
+    memcpy(v, "VBRI", 4);
+    put32(v + 10, 1000 * s_flen);                           // bytes
+    put32(v + 14, 1000);                                    // frames
+    put16(v + 18, 10);                                      // entries
+    put16(v + 20, 1);                                       // scale
+    put16(v + 22, 2);                                       // bytes per entry
+    put16(v + 24, 100);                                     // frames per entry
+    for(int e = 0; e < 10; e++) put16(v + 26 + e * 2, e < 5 ? 30000 : 53400); // a quiet first half, 417000 in total
+
+    VS1053* vs = mp3Player(f);
+    CHECK_EQ(vs->m_mp3.frames, 1000);
+    CHECK_EQ(vs->m_mp3.bytes, 1000 * s_flen);
+    CHECK(vs->m_mp3.f_toc);
+    CHECK_EQ(vs->m_mp3.toc[0], 0);
+    CHECK_EQ(vs->m_mp3.toc[9], 0);
+    CHECK_EQ(vs->m_mp3.toc[10], 18);                        // 30000 * 256 / 417000
+    CHECK_EQ(vs->m_mp3.toc[50], 92);                        // 150000 * 256 / 417000
+    CHECK_EQ(vs->m_mp3.toc[60], 124);                       // 203400 * 256 / 417000
+    CHECK_EQ(vs->m_mp3.toc[99], 223);                       // 363600 * 256 / 417000
+
+    // 13 s: 50%, toc[50] = 92 -> 92 / 256 * 417000 = 149859 -> frame 360
+    CHECK(vs->setAudioPlayPosition(13));
+    CHECK_EQ(vs->audiofile.position(), s_lead + 360 * s_flen);
+    delPlayer(vs);
+}
+
+static void test_cbr(){
+    std::vector<uint8_t> f = mp3File(1000);                 // no header, the duration comes from the bitrate
+    VS1053* vs = mp3Player(f);
+    CHECK_EQ(vs->m_mp3.frames, 0);
+    CHECK(!vs->m_mp3.f_toc);
+    CHECK_EQ(vs->getAudioFileDuration(), 26);               // 417000 * 8 / 128000
+
+    // 10 s: 417000 * 10 / 26 = 160384 -> frame 385
+    CHECK(vs->setAudioPlayPosition(10));
+    CHECK_EQ(vs->audiofile.position(), s_lead + 385 * s_flen);
+    delPlayer(vs);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+//      FLAC SEEKTABLE
+//----------------------------------------------------------------------------------------------------------------------
+static void put64(uint8_t* p, uint64_t v){put32(p, v >> 32); put32(p + 4, (uint32_t)v);}
+
+static void test_flacSeek(){
+    std::vector<uint8_t> f(200000, 0);
+    uint8_t* p = f.data();
+    memcpy(p, "fLaC", 4);                 p += 4;
+    p[0] = 0; p[3] = 34;                  p += 4;           // STREAMINFO
+    p[10] = 44100 >> 12; p[11] = (44100 >> 4) & 0xFF;       // 44.1 kHz, 2 channels, 16 bit, 441000 samples
+    p[12] = ((44100 & 0x0F) << 4) | (1 << 1) | 0;
+    p[13] = 15 << 4;
+    put32(p + 14, 441000);                p += 34;
+    p[0] = 0x80 | 3; p[3] = 4 * 18;       p += 4;           // SEEKTABLE, the last metadata block
+    const uint64_t smp[4] = {0, 176400, 352800, 0xFFFFFFFFFFFFFFFFULL};
+    const uint32_t off[4] = {0, 40000, 80000, 0};
+    for(int i = 0; i < 4; i++) {put64(p, smp[i]); put64(p + 8, off[i]); put16(p + 16, 4096); p += 18;}
+    const uint32_t audioStart = p - f.data();               // 118
+
+    VS1053* vs = newPlayer();
+    vs->audiofile = File(f.data(), f.size());
+    vs->m_codec = VS1053::CODEC_FLAC;
+    vs->m_controlCounter = 0;
+    size_t pos = 0;
+    for(int i = 0; i < 20 && vs->m_controlCounter != 100; i++) {
+        int res = vs->read_FLAC_Header(f.data() + pos, 7 + i * 10);  // the way it comes from InBuff, in pieces
+        CHECK(res >= 0);
+        pos += res;
+    }
+    CHECK_EQ(vs->m_controlCounter, 100);
+    CHECK_EQ(pos, audioStart);
+    CHECK_EQ(vs->m_flac.audioStart, audioStart);
+    CHECK_EQ(vs->m_flac.sampleRate, 44100);
+    CHECK_EQ(vs->m_flac.channels, 2);
+    CHECK_EQ(vs->m_flac.bitsPerSample, 16);
+    CHECK_EQ(vs->m_flac.totalSamples, 441000);
+    CHECK_EQ(vs->m_flacSeek.size(), 3);                     // without the placeholder
+
+    vs->m_datamode = VS1053::AUDIO_LOCALFILE;
+    CHECK_EQ(vs->getAudioFileDuration(), 10);
+    CHECK(vs->setAudioPlayPosition(5));                     // the seek point in front of it: 4 s
+    CHECK_EQ(vs->audiofile.position(), audioStart + 40000);
+    CHECK_EQ(vs->m_seekSec, 4);
+    CHECK(vs->setAudioPlayPosition(9));
+    CHECK_EQ(vs->audiofile.position(), audioStart + 80000);
+    CHECK_EQ(vs->m_seekSec, 8);
+    CHECK(vs->setAudioPlayPosition(1));
+    CHECK_EQ(vs->audiofile.position(), audioStart);
+    CHECK_EQ(vs->m_seekSec, 0);
+    delPlayer(vs);
+
+    vs = newPlayer();                                       // not a FLAC file
+    CHECK_EQ(vs->read_FLAC_Header((uint8_t*)"ID3\x04", 4), -1);
+    delPlayer(vs);
+}
+
+//----------------------------------------------------------------------------------------------------------------------
+int main(){
+    test_audioBuffer();
+    test_chunked();
+    test_rxBuffer();
+    test_mp3FrameLength();
+    test_xing();
+    test_vbri();
+    test_cbr();
+    test_flacSeek();
+    printf("%d checks, %d failed\n", s_checks, s_failed);
+    return s_failed ? 1 : 0;
+}